@@ -48,35 +48,52 @@
 // TDeintMod
 
 #ifdef VS_TARGET_CPU_X86
-template<typename T1, typename T2, int step> extern void threshMask_sse2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void threshMask_avx2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void threshMask_sse2(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void threshMask_avx2(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void threshMask_avx512(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
 
-template<typename T1, typename T2, int step> extern void motionMask_sse2(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void motionMask_avx2(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void packMotion_sse2(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void packMotion_avx2(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void packMotion_avx512(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
 
-template<typename T1, typename T2, int step> extern void andMasks_sse2(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void andMasks_avx2(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, typename T3, int step> extern void checkSpatial_sse2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, typename T3, int step> extern void checkSpatial_avx2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
 
-template<typename T1, typename T2, int step> extern void combineMasks_sse2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void combineMasks_avx2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void eDeint_sse2(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void eDeint_avx2(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+template<typename T1, typename T2, int step> extern void cubicDeint_sse2(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T1, typename T2, int step> extern void cubicDeint_avx2(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+extern void expandMask_sse2(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+extern void expandMask_avx2(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+template<int ssw, int ssh> extern void linkMask_sse2(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<int ssw, int ssh> extern void linkMask_avx2(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
 #endif
 
-#if defined(__ARM_NEON__)
-template<typename T1, typename T2, int step> extern void threshMask_sse2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void motionMask_sse2(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void andMasks_sse2(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template<typename T1, typename T2, int step> extern void combineMasks_sse2(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+template<typename T> extern void threshMask_neon(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T> extern void packMotion_neon(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T> extern void eDeint_neon(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template<typename T> extern void cubicDeint_neon(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
 #endif
 
+// the comb test of IsCombed, which TDeintMod runs itself with full=False
+static void initCombed(IsCombedData * d, const int opt, VSCore * core, const VSAPI * vsapi);
+static void freeCombed(IsCombedData * d) noexcept;
+static int64_t isCombed(const VSFrameRef * src, VSFrameRef * mask, VSMap * props, const IsCombedData * d, const VSAPI * vsapi) noexcept;
+
 template<typename T>
-static void copyPad(const VSFrameRef * src, VSFrameRef * dst, const int plane, const int widthPad, const VSAPI * vsapi) noexcept {
+static void copyPad(const VSFrameRef * src, VSFrameRef * dst, const int plane, const int parity, const int widthPad, const VSAPI * vsapi) noexcept {
     const int width = vsapi->getFrameWidth(src, plane);
-    const int height = vsapi->getFrameHeight(src, plane);
+    const int height = vsapi->getFrameHeight(src, plane) / 2;
+    const int srcStride = vsapi->getStride(src, plane);
     const int stride = vsapi->getStride(dst, 0) / sizeof(T);
-    const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
+    const uint8_t * srcp = vsapi->getReadPtr(src, plane) + srcStride * parity;
     T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + widthPad;
 
-    vs_bitblt(dstp, vsapi->getStride(dst, 0), srcp, vsapi->getStride(src, plane), width * sizeof(T), height);
+    vs_bitblt(dstp, vsapi->getStride(dst, 0), srcp, srcStride * 2, width * sizeof(T), height);
 
     for (int y = 0; y < height; y++) {
         dstp[-1] = dstp[1];
@@ -87,30 +104,36 @@ static void copyPad(const VSFrameRef * src, VSFrameRef * dst, const int plane, c
 }
 
 template<typename T>
-static void threshMask_c(const VSFrameRef * src, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+static void threshMask_c(const VSFrameRef * src, VSFrameRef * dst, const int plane, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     constexpr T peak = std::numeric_limits<T>::max();
 
     const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = d->vi.height >> (plane ? d->vi.format->subSamplingH : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
     const int stride = vsapi->getStride(src, 0) / sizeof(T);
     const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
     T * VS_RESTRICT dstp0 = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
     T * VS_RESTRICT dstp1 = dstp0 + stride * height;
 
+    const auto rows = stripRows(height, strip, d);
+
     if (plane == 0 && d->mtqL > -1 && d->mthL > -1) {
-        std::fill_n(dstp0 - d->widthPad, stride * height, static_cast<T>(d->mtqL));
-        std::fill_n(dstp1 - d->widthPad, stride * height, static_cast<T>(d->mthL));
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mtqL));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mthL));
         return;
     } else if (plane > 0 && d->mtqC > -1 && d->mthC > -1) {
-        std::fill_n(dstp0 - d->widthPad, stride * height, static_cast<T>(d->mtqC));
-        std::fill_n(dstp1 - d->widthPad, stride * height, static_cast<T>(d->mthC));
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mtqC));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mthC));
         return;
     }
 
-    const T * srcpp = srcp + stride;
-    const T * srcpn = srcpp;
+    // the rows above and below the strip are read in place, mirrored at the plane edges
+    srcp += stride * rows.first;
+    dstp0 += stride * rows.first;
+    dstp1 += stride * rows.first;
+    const T * srcpp = rows.first ? srcp - stride : srcp + stride;
+    const T * srcpn = (rows.first > 0 && rows.first == height - 1) ? srcp - stride : srcp + stride;
 
-    for (int y = 0; y < height; y++) {
+    for (int y = rows.first; y < rows.second; y++) {
         for (int x = 0; x < width; x++) {
             int min0 = peak, max0 = 0;
             int min1 = peak, max1 = 0;
@@ -311,304 +334,328 @@ static void threshMask_c(const VSFrameRef * src, VSFrameRef * dst, const int pla
         dstp1 += stride;
     }
 
-    T * dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0));
+    T * dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + stride * rows.first;
     if (plane == 0 && d->mtqL > -1)
-        std::fill_n(dstp, stride * height, static_cast<T>(d->mtqL));
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T>(d->mtqL));
     else if (plane == 0 && d->mthL > -1)
-        std::fill_n(dstp + stride * height, stride * height, static_cast<T>(d->mthL));
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T>(d->mthL));
     else if (plane > 0 && d->mtqC > -1)
-        std::fill_n(dstp, stride * height, static_cast<T>(d->mtqC));
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T>(d->mtqC));
     else if (plane > 0 && d->mthC > -1)
-        std::fill_n(dstp + stride * height, stride * height, static_cast<T>(d->mthC));
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T>(d->mthC));
 }
 
+// Motion masks are bit-packed, 64 pixels per word: bit x & 63 of word x >> 6 is set where the pixel is stationary. Bits past the
+// plane width are always clear. packMotion produces row y of the quarter- and half-threshold masks between two fields at once.
 template<typename T>
-static void motionMask_c(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, VSFrameRef * dst,
-                         const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    constexpr T peak = std::numeric_limits<T>::max();
-
+static void packMotion_c(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, uint64_t * dstpq, uint64_t * dstph,
+                         const int y, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = d->vi.height >> (plane ? d->vi.format->subSamplingH : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
     const int stride = vsapi->getStride(src1, 0) / sizeof(T);
-    const T * srcp1 = reinterpret_cast<const T *>(vsapi->getReadPtr(src1, 0)) + d->widthPad;
-    const T * srcp2 = reinterpret_cast<const T *>(vsapi->getReadPtr(src2, 0)) + d->widthPad;
-    const T * mskp1q = reinterpret_cast<const T *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad;
-    const T * mskp2q = reinterpret_cast<const T *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad;
-    T * VS_RESTRICT dstpq = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
-
+    const T * srcp1 = reinterpret_cast<const T *>(vsapi->getReadPtr(src1, 0)) + d->widthPad + stride * y;
+    const T * srcp2 = reinterpret_cast<const T *>(vsapi->getReadPtr(src2, 0)) + d->widthPad + stride * y;
+    const T * mskp1q = reinterpret_cast<const T *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad + stride * y;
+    const T * mskp2q = reinterpret_cast<const T *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad + stride * y;
     const T * mskp1h = mskp1q + stride * height;
     const T * mskp2h = mskp2q + stride * height;
-    T * VS_RESTRICT dstph = dstpq + stride * height;
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            const int diff = std::abs(srcp1[x] - srcp2[x]);
-            dstpq[x] = (diff <= std::min(std::max(std::min(mskp1q[x], mskp2q[x]) + d->nt, d->minthresh), d->maxthresh)) ? peak : 0;
-            dstph[x] = (diff <= std::min(std::max(std::min(mskp1h[x], mskp2h[x]) + d->nt, d->minthresh), d->maxthresh)) ? peak : 0;
-        }
+    std::fill_n(dstpq, (width + 63) / 64, 0);
+    std::fill_n(dstph, (width + 63) / 64, 0);
 
-        srcp1 += stride;
-        srcp2 += stride;
-        mskp1q += stride;
-        mskp1h += stride;
-        mskp2q += stride;
-        mskp2h += stride;
-        dstpq += stride;
-        dstph += stride;
+    for (int x = 0; x < width; x++) {
+        const int diff = std::abs(srcp1[x] - srcp2[x]);
+        if (diff <= std::min(std::max(std::min(mskp1q[x], mskp2q[x]) + d->nt, d->minthresh), d->maxthresh))
+            dstpq[x >> 6] |= static_cast<uint64_t>(1) << (x & 63);
+        if (diff <= std::min(std::max(std::min(mskp1h[x], mskp2h[x]) + d->nt, d->minthresh), d->maxthresh))
+            dstph[x >> 6] |= static_cast<uint64_t>(1) << (x & 63);
     }
 }
 
-template<typename T>
-static void andMasks_c(const VSFrameRef * src1, const VSFrameRef * src2, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = (d->vi.height * 2) >> (plane ? d->vi.format->subSamplingH : 0);
-    const int stride = vsapi->getStride(src1, 0) / sizeof(T);
-    const T * srcp1 = reinterpret_cast<const T *>(vsapi->getReadPtr(src1, 0)) + d->widthPad;
-    const T * srcp2 = reinterpret_cast<const T *>(vsapi->getReadPtr(src2, 0)) + d->widthPad;
-    T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
+static void motionMask(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, VSFrameRef * dst,
+                       const int plane, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
+    const int stride = vsapi->getStride(dst, plane) / sizeof(uint64_t);
+    uint64_t * dstp = reinterpret_cast<uint64_t *>(vsapi->getWritePtr(dst, plane));
+    const auto rows = stripRows(height, strip, d);
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++)
-            dstp[x] &= srcp1[x] & srcp2[x];
+    for (int y = rows.first; y < rows.second; y++)
+        d->packMotion(src1, msk1, src2, msk2, dstp + stride * y, dstp + stride * (y + height), y, plane, d, vsapi);
+}
 
-        dstp[-1] = dstp[1];
-        dstp[width] = dstp[width - 2];
+// pixel x - 1 of every bit, mirrored at the left edge. A plane 1 pixel wide mirrors onto itself.
+static inline uint64_t westBits(const uint64_t * row, const int k, const int width) noexcept {
+    return (row[k] << 1) | (k ? row[k - 1] >> 63 : (row[0] >> std::min(width - 1, 1)) & 1);
+}
 
-        srcp1 += stride;
-        srcp2 += stride;
-        dstp += stride;
+// pixel x + 1 of every bit, mirrored at the right edge
+static inline uint64_t eastBits(const uint64_t * row, const int k, const int width) noexcept {
+    const int words = (width + 63) / 64;
+    uint64_t east = (row[k] >> 1) | (k + 1 < words ? row[k + 1] << 63 : 0);
+    if (k == words - 1) {
+        const int b = (width - 1) & 63;
+        east &= ~(static_cast<uint64_t>(1) << b);
+        const int mirror = std::max(width - 2, 0);
+        east |= ((row[mirror >> 6] >> (mirror & 63)) & 1) << b;
     }
+    return east;
 }
 
-template<typename T>
-static void combineMasks_c(const VSFrameRef * src, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    constexpr T peak = std::numeric_limits<T>::max();
-
-    const int width = vsapi->getFrameWidth(dst, plane);
-    const int height = vsapi->getFrameHeight(dst, plane);
-    const int srcStride = vsapi->getStride(src, 0) / sizeof(T);
-    const int dstStride = vsapi->getStride(dst, plane) / sizeof(T);
-    const T * srcp0 = reinterpret_cast<const T *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
-    T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane));
-
-    const T * srcpp0 = srcp0 + srcStride;
-    const T * srcpn0 = srcpp0;
-    const T * srcp1 = srcp0 + srcStride * height;
-
-    vs_bitblt(dstp, vsapi->getStride(dst, plane), srcp0, vsapi->getStride(src, 0), width * sizeof(T), height);
+// Fused tail of the TMM stage: the motion mask between fields n and n + 2, ANDed with the two adjacent-pair masks, then combined
+// into the packed output plane. Rows are produced on demand into a three-line ring, and the 3x3 neighbour count is done with
+// bit-sliced adders, 64 pixels at a time. A strip recomputes the ANDed rows just above and below itself rather than sharing them.
+static void combineMasks(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2,
+                         const VSFrameRef * mot1, const VSFrameRef * mot2, VSFrameRef * dst, const int plane, const int strip, const TDeintModData * d,
+                         const VSAPI * vsapi) noexcept {
+    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
+    const int words = (width + 63) / 64;
+    const int motStride = vsapi->getStride(mot1, plane) / sizeof(uint64_t);
+    const int dstStride = vsapi->getStride(dst, plane) / sizeof(uint64_t);
+    const uint64_t * motp1 = reinterpret_cast<const uint64_t *>(vsapi->getReadPtr(mot1, plane));
+    const uint64_t * motp2 = reinterpret_cast<const uint64_t *>(vsapi->getReadPtr(mot2, plane));
+    uint64_t * VS_RESTRICT dstp = reinterpret_cast<uint64_t *>(vsapi->getWritePtr(dst, plane));
+    const auto rows = stripRows(height, strip, d);
+    if (rows.first == rows.second)
+        return;
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            if (srcp0[x] || !srcp1[x])
-                continue;
+    auto scratch = d->scratch->scope();
+    uint64_t * ring = scratch.alloc<uint64_t>(words * 6);
 
-            int count = 0;
-
-            if (srcpp0[x - 1])
-                count++;
-            if (srcpp0[x])
-                count++;
-            if (srcpp0[x + 1])
-                count++;
-            if (srcp0[x - 1])
-                count++;
-            if (srcp0[x + 1])
-                count++;
-            if (srcpn0[x - 1])
-                count++;
-            if (srcpn0[x])
-                count++;
-            if (srcpn0[x + 1])
-                count++;
-
-            if (count >= d->cstr)
-                dstp[x] = peak;
+    auto andRow = [&](uint64_t * rowq, uint64_t * rowh, const int y) noexcept {
+        d->packMotion(src1, msk1, src2, msk2, rowq, rowh, y, plane, d, vsapi);
+        for (int k = 0; k < words; k++) {
+            rowq[k] &= motp1[motStride * y + k] & motp2[motStride * y + k];
+            rowh[k] &= motp1[motStride * (y + height) + k] & motp2[motStride * (y + height) + k];
         }
+    };
+
+    uint64_t * srcpp0 = ring;
+    uint64_t * srcp0 = ring + words;
+    uint64_t * srcpn0 = ring + words * 2;
+    uint64_t * srcpp1 = ring + words * 3;
+    uint64_t * srcp1 = ring + words * 4;
+    uint64_t * srcpn1 = ring + words * 5;
+
+    // rows -1 and height are mirrored
+    const int first = rows.first;
+    andRow(srcp0, srcp1, first);
+    andRow(srcpn0, srcpn1, (first > 0 && first == height - 1) ? first - 1 : first + 1);
+    if (first == 0)
+        std::copy_n(srcpn0, words, srcpp0);
+    else
+        andRow(srcpp0, srcpp1, first - 1);
+
+    dstp += dstStride * first;
+
+    const int cstr = std::max(d->cstr, 0);
+
+    for (int y = first; y < rows.second; y++) {
+        for (int k = 0; k < words; k++) {
+            const uint64_t n[] = { westBits(srcpp0, k, width), srcpp0[k], eastBits(srcpp0, k, width),
+                                   westBits(srcp0, k, width), eastBits(srcp0, k, width),
+                                   westBits(srcpn0, k, width), srcpn0[k], eastBits(srcpn0, k, width) };
+
+            // sum the eight neighbour planes into a 4-bit count c3..c0
+            const uint64_t s1 = n[0] ^ n[1] ^ n[2], a1 = (n[0] & n[1]) | ((n[0] ^ n[1]) & n[2]);
+            const uint64_t s2 = n[3] ^ n[4] ^ n[5], a2 = (n[3] & n[4]) | ((n[3] ^ n[4]) & n[5]);
+            const uint64_t s3 = n[6] ^ n[7], a3 = n[6] & n[7];
+            const uint64_t c0 = s1 ^ s2 ^ s3, a4 = (s1 & s2) | ((s1 ^ s2) & s3);
+            const uint64_t t = a1 ^ a2 ^ a3, a5 = (a1 & a2) | ((a1 ^ a2) & a3);
+            const uint64_t c1 = t ^ a4, a6 = t & a4;
+            const uint64_t c2 = a5 ^ a6, c3 = a5 & a6;
+            const uint64_t c[] = { c0, c1, c2, c3 };
+
+            // count >= cstr, most significant bit first
+            uint64_t gt = 0, eq = ~static_cast<uint64_t>(0);
+            if (cstr > 15) {
+                eq = 0;
+            } else {
+                for (int b = 3; b >= 0; b--) {
+                    if (cstr & (1 << b)) {
+                        eq &= c[b];
+                    } else {
+                        gt |= eq & c[b];
+                        eq &= ~c[b];
+                    }
+                }
+            }
 
-        srcpp0 = srcp0;
-        srcp0 = srcpn0;
-        srcpn0 += (y < height - 2) ? srcStride : -srcStride;
-        srcp1 += srcStride;
+            dstp[k] = srcp0[k] | (srcp1[k] & (gt | eq));
+        }
+        if (width & 63)
+            dstp[words - 1] &= (static_cast<uint64_t>(1) << (width & 63)) - 1;
+
+        std::swap(srcpp0, srcp0);
+        std::swap(srcp0, srcpn0);
+        std::swap(srcpp1, srcp1);
+        std::swap(srcp1, srcpn1);
+        if (y < rows.second - 1)
+            andRow(srcpn0, srcpn1, (y < height - 2) ? y + 2 : y);
         dstp += dstStride;
     }
 }
 
-template<typename T>
-static void buildMask(VSFrameRef ** cSrc, VSFrameRef ** oSrc, VSFrameRef * dst, const int cCount, const int oCount, const int order, const int field,
-                      const TDeintModData * d, const VSAPI * vsapi) noexcept {
+// byte i of spreadBits[b] is bit i of b
+static constexpr std::array<uint64_t, 256> spreadBits = [] {
+    std::array<uint64_t, 256> table{};
+    for (int b = 0; b < 256; b++) {
+        for (int i = 0; i < 8; i++)
+            table[b] |= static_cast<uint64_t>((b >> i) & 1) << (i * 8);
+    }
+    return table;
+}();
+
+// Builds the TMM value of every pixel from the packed field masks. For each 64-pixel word the stationary windows of span
+// length - 4 are ANDed out of the interleaved field sequence with the prefix/suffix block trick, giving the six bits of the
+// vlut index as bit planes. These are then spread to one byte per pixel, eight pixels at a time, for the final table lookup.
+static void buildMask(const VSFrameRef ** cSrc, const VSFrameRef ** oSrc, VSFrameRef * dst, const int cCount, const int oCount, const int order, const int field,
+                      const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    // bit 6 of the index marks pixels that are moving in the current field
     const uint8_t * tmmlut = d->tmmlut16.data() + order * 8 + field * 4;
-    uint8_t tmmlutf[64];
-    for (int i = 0; i < 64; i++)
+    uint8_t tmmlutf[128];
+    for (int i = 0; i < 64; i++) {
         tmmlutf[i] = tmmlut[d->vlut[i]];
+        tmmlutf[i + 64] = 60;
+    }
 
-    T * VS_RESTRICT plut[2];
-    for (int i = 0; i < 2; i++)
-        plut[i] = new T[2 * d->length - 1];
-
-    T * VS_RESTRICT * VS_RESTRICT ptlut[3];
-    for (int i = 0; i < 3; i++)
-        ptlut[i] = new T *[i & 1 ? cCount : oCount];
+    auto scratch = d->scratch->scope();
 
     const int offo = (d->length & 1) ? 0 : 1;
     const int offc = (d->length & 1) ? 1 : 0;
+    const int span = d->length - 4;
+    const int count = d->length + span - 1;
     const int ct = cCount / 2;
 
+    uint64_t * plut[2], * prefix[2], * suffix[2];
+    for (int i = 0; i < 2; i++) {
+        plut[i] = scratch.alloc<uint64_t>(count);
+        prefix[i] = scratch.alloc<uint64_t>(count);
+        suffix[i] = scratch.alloc<uint64_t>(count);
+    }
+
+    const uint64_t ** ptlut[3];
+    for (int i = 0; i < 3; i++)
+        ptlut[i] = scratch.alloc<const uint64_t *>(i & 1 ? cCount : oCount);
+
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
         if (d->process[plane]) {
             const int width = vsapi->getFrameWidth(dst, plane);
             const int height = vsapi->getFrameHeight(dst, plane);
-            const int stride = vsapi->getStride(dst, plane) / sizeof(T);
-            for (int i = 0; i < cCount; i++)
-                ptlut[1][i] = reinterpret_cast<T *>(vsapi->getWritePtr(cSrc[i], plane));
-            for (int i = 0; i < oCount; i++) {
-                if (field == 1) {
-                    ptlut[0][i] = reinterpret_cast<T *>(vsapi->getWritePtr(oSrc[i], plane));
-                    ptlut[2][i] = ptlut[0][i] + stride;
-                } else {
-                    ptlut[0][i] = ptlut[2][i] = reinterpret_cast<T *>(vsapi->getWritePtr(oSrc[i], plane));
-                }
-            }
-            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane));
+            const int stride = vsapi->getStride(dst, plane);
+            const int srcStride = vsapi->getStride(cSrc[0], plane) / sizeof(uint64_t);
+            const int words = (width + 63) / 64;
+            uint8_t * VS_RESTRICT dstp = vsapi->getWritePtr(dst, plane);
 
-            if (field == 1) {
-                for (int j = 0; j < height; j += 2)
-                    std::fill_n(dstp + stride * j, width, static_cast<T>(10));
-                dstp += stride;
-            } else {
-                for (int j = 1; j < height; j += 2)
-                    std::fill_n(dstp + stride * j, width, static_cast<T>(10));
-            }
+            // strips are made of whole row pairs, the rows of the kept field are all 10
+            const auto pairs = stripRows((height + 1) / 2, strip, d);
+            const int last = std::min(pairs.second * 2, height);
 
-            for (int y = field; y < height; y += 2) {
-                for (int x = 0; x < width; x++) {
-                    if (!ptlut[1][ct - 2][x] && !ptlut[1][ct][x] && !ptlut[1][ct + 1][x]) {
-                        dstp[x] = 60;
-                        continue;
-                    }
+            for (int j = pairs.first * 2 + 1 - field; j < last; j += 2)
+                std::fill_n(dstp + stride * j, width, static_cast<uint8_t>(10));
+            dstp += stride * (pairs.first * 2 + field);
+
+            for (int y = pairs.first * 2 + field; y < last; y += 2) {
+                const int r = y / 2;
+                const int above = (field == 1) ? r : std::max(r - 1, 0);
+                const int below = (field == 1) ? std::min(r + 1, height / 2 - 1) : r;
+
+                for (int i = 0; i < cCount; i++)
+                    ptlut[1][i] = reinterpret_cast<const uint64_t *>(vsapi->getReadPtr(cSrc[i], plane)) + srcStride * r;
+                for (int i = 0; i < oCount; i++) {
+                    const uint64_t * srcp = reinterpret_cast<const uint64_t *>(vsapi->getReadPtr(oSrc[i], plane));
+                    ptlut[0][i] = srcp + srcStride * above;
+                    ptlut[2][i] = srcp + srcStride * below;
+                }
 
+                for (int k = 0; k < words; k++) {
                     for (int j = 0; j < cCount; j++)
-                        plut[0][j * 2 + offc] = plut[1][j * 2 + offc] = ptlut[1][j][x];
+                        plut[0][j * 2 + offc] = plut[1][j * 2 + offc] = ptlut[1][j][k];
                     for (int j = 0; j < oCount; j++) {
-                        plut[0][j * 2 + offo] = ptlut[0][j][x];
-                        plut[1][j * 2 + offo] = ptlut[2][j][x];
+                        plut[0][j * 2 + offo] = ptlut[0][j][k];
+                        plut[1][j * 2 + offo] = ptlut[2][j][k];
                     }
 
-                    int val = 0;
-                    for (int i = 0; i < d->length; i++) {
-                        for (int j = 0; j < d->length - 4; j++) {
-                            if (!plut[0][i + j])
-                                goto j1;
-                        }
-                        val |= d->gvlut[i] * 8;
-                    j1:
-                        for (int j = 0; j < d->length - 4; j++) {
-                            if (!plut[1][i + j])
-                                goto j2;
+                    uint64_t val[7] = {};
+                    for (int p = 0; p < 2; p++) {
+                        for (int j = 0; j < count; j++)
+                            prefix[p][j] = (j % span) ? prefix[p][j - 1] & plut[p][j] : plut[p][j];
+                        for (int j = count - 1; j >= 0; j--)
+                            suffix[p][j] = (j % span != span - 1 && j < count - 1) ? suffix[p][j + 1] & plut[p][j] : plut[p][j];
+
+                        // the window starting at i covers [i, i + span - 1]
+                        for (int i = 0; i < d->length; i++) {
+                            const uint64_t window = (i % span) ? suffix[p][i] & prefix[p][i + span - 1] : prefix[p][i + span - 1];
+                            const int bit = (d->gvlut[i] >> 1) + (p ? 0 : 3);
+                            val[bit] |= window;
                         }
-                        val |= d->gvlut[i];
-                    j2:
-                        if (d->vlut[val] == 2)
-                            break;
                     }
-                    dstp[x] = tmmlutf[val];
-                }
+                    val[6] = ~(ptlut[1][ct - 2][k] | ptlut[1][ct][k] | ptlut[1][ct + 1][k]);
 
-                for (int i = 0; i < cCount; i++)
-                    ptlut[1][i] += stride;
-                for (int i = 0; i < oCount; i++) {
-                    if (y != 0)
-                        ptlut[0][i] += stride;
-                    if (y != height - 3)
-                        ptlut[2][i] += stride;
+                    for (int x = k * 64; x < std::min(k * 64 + 64, width); x += 8) {
+                        const int shift = x & 63;
+                        uint64_t index = 0;
+                        for (int b = 0; b < 7; b++)
+                            index |= spreadBits[(val[b] >> shift) & 0xFF] << b;
+
+                        const int n = std::min(8, width - x);
+                        for (int i = 0; i < n; i++)
+                            dstp[x + i] = tmmlutf[(index >> (i * 8)) & 0x7F];
+                    }
                 }
+
                 dstp += stride * 2;
             }
         }
     }
-
-    for (int i = 0; i < 2; i++)
-        delete[] plut[i];
-    for (int i = 0; i < 3; i++)
-        delete[] ptlut[i];
 }
 
-template<typename T>
-static void setMaskForUpsize(VSFrameRef * mask, const int field, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+static void setMaskForUpsize(VSFrameRef * mask, const int field, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
         if (d->process[plane]) {
             const int width = vsapi->getFrameWidth(mask, plane);
             const int height = vsapi->getFrameHeight(mask, plane) / 2;
-            const int stride = vsapi->getStride(mask, plane) / sizeof(T) * 2;
-            T * VS_RESTRICT maskwc = reinterpret_cast<T *>(vsapi->getWritePtr(mask, plane));
-            T * VS_RESTRICT maskwn = maskwc + stride / 2;
-
-            if (field == 1) {
-                for (int y = 0; y < height - 1; y++) {
-                    std::fill_n(maskwc, width, static_cast<T>(10));
-                    std::fill_n(maskwn, width, static_cast<T>(60));
-                    maskwc += stride;
-                    maskwn += stride;
-                }
-                std::fill_n(maskwc, width, static_cast<T>(10));
-                std::fill_n(maskwn, width, static_cast<T>(10));
-            } else {
-                std::fill_n(maskwc, width, static_cast<T>(10));
-                std::fill_n(maskwn, width, static_cast<T>(10));
-                for (int y = 0; y < height - 1; y++) {
-                    maskwc += stride;
-                    maskwn += stride;
-                    std::fill_n(maskwc, width, static_cast<T>(60));
-                    std::fill_n(maskwn, width, static_cast<T>(10));
+            const int stride = vsapi->getStride(mask, plane) * 2;
+            const auto rows = stripRows(height, strip, d);
+            uint8_t * VS_RESTRICT maskwc = vsapi->getWritePtr(mask, plane) + stride * rows.first;
+            uint8_t * VS_RESTRICT maskwn = maskwc + stride / 2;
+
+            // the kept field is 10, the interpolated one 60 except for its row on the frame edge
+            for (int y = rows.first; y < rows.second; y++) {
+                if (field == 1) {
+                    std::fill_n(maskwc, width, static_cast<uint8_t>(10));
+                    std::fill_n(maskwn, width, static_cast<uint8_t>(y < height - 1 ? 60 : 10));
+                } else {
+                    std::fill_n(maskwc, width, static_cast<uint8_t>(y > 0 ? 60 : 10));
+                    std::fill_n(maskwn, width, static_cast<uint8_t>(10));
                 }
+                maskwc += stride;
+                maskwn += stride;
             }
         }
     }
 }
 
 template<typename T>
-static void checkSpatial(const VSFrameRef * src, VSFrameRef * dst, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+static void checkSpatial(const VSFrameRef * src, VSFrameRef * dst, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
         if (d->process[plane]) {
             const int width = vsapi->getFrameWidth(src, plane);
             const int height = vsapi->getFrameHeight(src, plane);
             const int stride = vsapi->getStride(src, plane) / sizeof(T);
-            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
-            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane));
-
-            const T * srcppp = srcp - stride * 2;
-            const T * srcpp = srcp - stride;
-            const T * srcpn = srcp + stride;
-            const T * srcpnn = srcp + stride * 2;
-
-            if (d->metric == 0) {
-                for (int x = 0; x < width; x++) {
-                    const int sFirst = srcp[x] - srcpn[x];
-                    if (dstp[x] == 60 && !((sFirst > d->athresh || sFirst < -d->athresh) &&
-                                           std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpn[x] + srcpn[x])) > d->athresh6))
-                        dstp[x] = 10;
-                }
-                srcppp += stride;
-                srcpp += stride;
-                srcp += stride;
-                srcpn += stride;
-                srcpnn += stride;
-                dstp += stride;
-
-                for (int x = 0; x < width; x++) {
-                    const int sFirst = srcp[x] - srcpp[x];
-                    const int sSecond = srcp[x] - srcpn[x];
-                    if (dstp[x] == 60 && !(((sFirst > d->athresh && sSecond > d->athresh) || (sFirst < -d->athresh && sSecond < -d->athresh)) &&
-                                           std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->athresh6))
-                        dstp[x] = 10;
-                }
-                srcppp += stride;
-                srcpp += stride;
-                srcp += stride;
-                srcpn += stride;
-                srcpnn += stride;
-                dstp += stride;
-
-                for (int y = 2; y < height - 2; y++) {
+            const int dstStride = vsapi->getStride(dst, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            uint8_t * VS_RESTRICT dstp = vsapi->getWritePtr(dst, plane) + dstStride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
+                // rows past the top and bottom are mirrored
+                const T * srcppp = srcp + stride * (y > 1 ? -2 : 2);
+                const T * srcpp = srcp + stride * (y > 0 ? -1 : 1);
+                const T * srcpn = srcp + stride * (y < height - 1 ? 1 : -1);
+                const T * srcpnn = srcp + stride * (y < height - 2 ? 2 : -2);
+
+                if (d->metric == 0) {
                     for (int x = 0; x < width; x++) {
                         const int sFirst = srcp[x] - srcpp[x];
                         const int sSecond = srcp[x] - srcpn[x];
@@ -616,93 +663,50 @@ static void checkSpatial(const VSFrameRef * src, VSFrameRef * dst, const TDeintM
                                                std::abs(srcppp[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->athresh6))
                             dstp[x] = 10;
                     }
-                    srcppp += stride;
-                    srcpp += stride;
-                    srcp += stride;
-                    srcpn += stride;
-                    srcpnn += stride;
-                    dstp += stride;
-                }
-
-                for (int x = 0; x < width; x++) {
-                    const int sFirst = srcp[x] - srcpp[x];
-                    const int sSecond = srcp[x] - srcpn[x];
-                    if (dstp[x] == 60 && !(((sFirst > d->athresh && sSecond > d->athresh) || (sFirst < -d->athresh && sSecond < -d->athresh)) &&
-                                           std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpn[x])) > d->athresh6))
-                        dstp[x] = 10;
-                }
-                srcppp += stride;
-                srcpp += stride;
-                srcp += stride;
-                srcpn += stride;
-                srcpnn += stride;
-                dstp += stride;
-
-                for (int x = 0; x < width; x++) {
-                    const int sFirst = srcp[x] - srcpp[x];
-                    if (dstp[x] == 60 && !((sFirst > d->athresh || sFirst < -d->athresh) &&
-                                           std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpp[x])) > d->athresh6))
-                        dstp[x] = 10;
-                }
-            } else {
-                for (int x = 0; x < width; x++) {
-                    if (dstp[x] == 60 && !((srcp[x] - srcpn[x]) * (srcp[x] - srcpn[x]) > d->athreshsq))
-                        dstp[x] = 10;
-                }
-                srcpp += stride;
-                srcp += stride;
-                srcpn += stride;
-                dstp += stride;
-
-                for (int y = 1; y < height - 1; y++) {
+                } else {
                     for (int x = 0; x < width; x++) {
-                        if (dstp[x] == 60 && !((srcp[x] - srcpp[x]) * (srcp[x] - srcpn[x]) > d->athreshsq))
+                        // the product of two 16-bit differences does not fit in int
+                        if (dstp[x] == 60 && !(static_cast<int64_t>(srcp[x] - srcpp[x]) * (srcp[x] - srcpn[x]) > d->athreshsq))
                             dstp[x] = 10;
                     }
-                    srcpp += stride;
-                    srcp += stride;
-                    srcpn += stride;
-                    dstp += stride;
                 }
 
-                for (int x = 0; x < width; x++) {
-                    if (dstp[x] == 60 && !((srcp[x] - srcpp[x]) * (srcp[x] - srcpp[x]) > d->athreshsq))
-                        dstp[x] = 10;
-                }
+                srcp += stride;
+                dstp += dstStride;
             }
         }
     }
 }
 
-template<typename T>
-static void expandMask(VSFrameRef * mask, const int field, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+static void expandMask(VSFrameRef * mask, const int field, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
-        if (d->process[plane]) {
+        const int dis = d->expand >> (plane ? d->vi.format->subSamplingW : 0);
+
+        if (d->process[plane] && dis > 0) {
             const int width = vsapi->getFrameWidth(mask, plane);
             const int height = vsapi->getFrameHeight(mask, plane);
-            const int stride = vsapi->getStride(mask, plane) / sizeof(T) * 2;
-            T * VS_RESTRICT maskp = reinterpret_cast<T *>(vsapi->getWritePtr(mask, plane)) + stride / 2 * field;
+            const int stride = vsapi->getStride(mask, plane) * 2;
+            const auto rows = stripRows((height - field + 1) / 2, strip, d);
+            uint8_t * VS_RESTRICT maskp = vsapi->getWritePtr(mask, plane) + stride / 2 * field + stride * rows.first;
 
-            const int dis = d->expand >> (plane ? d->vi.format->subSamplingW : 0);
+            for (int y = rows.first; y < rows.second; y++) {
+                // a pixel becomes 60 when a 60 of the input is at most dis away on either side. Only pixels behind x are written,
+                // so the last 60 behind and the next one ahead are both found among the input values, each with a single forward scan.
+                int last = -dis - 1;
+                int next = -1;
 
-            for (int y = field; y < height; y += 2) {
                 for (int x = 0; x < width; x++) {
                     if (maskp[x] == 60) {
-                        int xt = x - 1;
-                        while (xt >= 0 && xt >= x - dis)
-                            maskp[xt--] = 60;
-                        xt = x + 1;
-
-                        int nc = x + dis + 1;
-                        while (xt < width && xt <= x + dis) {
-                            if (maskp[xt] == 60) {
-                                nc = xt;
-                                break;
-                            } else {
-                                maskp[xt++] = 60;
-                            }
+                        last = x;
+                    } else {
+                        if (next < x) {
+                            next = x + 1;
+                            while (next < width && maskp[next] != 60)
+                                next++;
                         }
-                        x = nc - 1;
+
+                        if (x - last <= dis || (next < width && next - x <= dis))
+                            maskp[x] = 60;
                     }
                 }
 
@@ -712,50 +716,32 @@ static void expandMask(VSFrameRef * mask, const int field, const TDeintModData *
     }
 }
 
-template<typename T>
-static void linkMask(VSFrameRef * mask, const int field, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+template<int ssw, int ssh>
+static void linkMask(VSFrameRef * mask, const int field, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     const int width = vsapi->getFrameWidth(mask, 2);
     const int height = vsapi->getFrameHeight(mask, 2);
-    const int strideY = vsapi->getStride(mask, 0) / sizeof(T);
-    const int strideUV = vsapi->getStride(mask, 2) / sizeof(T);
-    const T * maskpY = reinterpret_cast<const T *>(vsapi->getReadPtr(mask, 0)) + strideY * field;
-    T * VS_RESTRICT maskpU = reinterpret_cast<T *>(vsapi->getWritePtr(mask, 1)) + strideUV * field;
-    T * VS_RESTRICT maskpV = reinterpret_cast<T *>(vsapi->getWritePtr(mask, 2)) + strideUV * field;
+    const int strideY = vsapi->getStride(mask, 0);
+    const int strideUV = vsapi->getStride(mask, 2);
+    const int strideY2 = strideY * (2 << ssh);
+    const int strideUV2 = strideUV * 2;
+    const auto rows = stripRows((height - field + 1) / 2, strip, d);
 
-    const T * maskpnY = maskpY + strideY * 2;
+    const uint8_t * maskpY = vsapi->getReadPtr(mask, 0) + strideY * field + strideY2 * rows.first;
+    uint8_t * VS_RESTRICT maskpU = vsapi->getWritePtr(mask, 1) + strideUV * field + strideUV2 * rows.first;
+    uint8_t * VS_RESTRICT maskpV = vsapi->getWritePtr(mask, 2) + strideUV * field + strideUV2 * rows.first;
 
-    const int strideY2 = strideY * (2 << d->vi.format->subSamplingH);
-    const int strideUV2 = strideUV * 2;
+    const uint8_t * maskpnY = maskpY + strideY * 2;
 
-    for (int y = field; y < height; y += 2) {
+    for (int y = rows.first; y < rows.second; y++) {
         for (int x = 0; x < width; x++) {
-            if (d->vi.format->subSamplingW == 0) {
-                if (d->vi.format->subSamplingH == 0) {
-                    if (maskpY[x] == 0x3C)
-                        maskpU[x] = maskpV[x] = 0x3C;
-                } else {
-                    if (maskpY[x] == 0x3C && maskpnY[x] == 0x3C)
-                        maskpU[x] = maskpV[x] = 0x3C;
-                }
-            } else {
-                if (std::is_same<T, uint8_t>::value) {
-                    if (d->vi.format->subSamplingH == 0) {
-                        if (reinterpret_cast<const uint16_t *>(maskpY)[x] == 0x3C3C)
-                            maskpU[x] = maskpV[x] = 0x3C;
-                    } else {
-                        if (reinterpret_cast<const uint16_t *>(maskpY)[x] == 0x3C3C && reinterpret_cast<const uint16_t *>(maskpnY)[x] == 0x3C3C)
-                            maskpU[x] = maskpV[x] = 0x3C;
-                    }
-                } else {
-                    if (d->vi.format->subSamplingH == 0) {
-                        if (reinterpret_cast<const uint32_t *>(maskpY)[x] == 0x3C003C)
-                            maskpU[x] = maskpV[x] = 0x3C;
-                    } else {
-                        if (reinterpret_cast<const uint32_t *>(maskpY)[x] == 0x3C003C && reinterpret_cast<const uint32_t *>(maskpnY)[x] == 0x3C003C)
-                            maskpU[x] = maskpV[x] = 0x3C;
-                    }
-                }
-            }
+            bool combed;
+            if (ssw == 0)
+                combed = maskpY[x] == 0x3C && (ssh == 0 || maskpnY[x] == 0x3C);
+            else
+                combed = reinterpret_cast<const uint16_t *>(maskpY)[x] == 0x3C3C && (ssh == 0 || reinterpret_cast<const uint16_t *>(maskpnY)[x] == 0x3C3C);
+
+            if (combed)
+                maskpU[x] = maskpV[x] = 0x3C;
         }
 
         maskpY += strideY2;
@@ -767,20 +753,22 @@ static void linkMask(VSFrameRef * mask, const int field, const TDeintModData * d
 
 template<typename T>
 static void eDeint(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef * prv, const VSFrameRef * src, const VSFrameRef * nxt, const VSFrameRef * edeint,
-                   const TDeintModData * d, const VSAPI * vsapi) noexcept {
+                   const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
         if (d->process[plane]) {
             const int width = vsapi->getFrameWidth(src, plane);
             const int height = vsapi->getFrameHeight(src, plane);
             const int stride = vsapi->getStride(src, plane) / sizeof(T);
-            const T * prvp = reinterpret_cast<const T *>(vsapi->getReadPtr(prv, plane));
-            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
-            const T * nxtp = reinterpret_cast<const T *>(vsapi->getReadPtr(nxt, plane));
-            const T * maskp = reinterpret_cast<const T *>(vsapi->getReadPtr(mask, plane));
-            const T * edeintp = reinterpret_cast<const T *>(vsapi->getReadPtr(edeint, plane));
-            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane));
-
-            for (int y = 0; y < height; y++) {
+            const int maskStride = vsapi->getStride(mask, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T * prvp = reinterpret_cast<const T *>(vsapi->getReadPtr(prv, plane)) + stride * rows.first;
+            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            const T * nxtp = reinterpret_cast<const T *>(vsapi->getReadPtr(nxt, plane)) + stride * rows.first;
+            const uint8_t * maskp = vsapi->getReadPtr(mask, plane) + maskStride * rows.first;
+            const T * edeintp = reinterpret_cast<const T *>(vsapi->getReadPtr(edeint, plane)) + stride * rows.first;
+            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane)) + stride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
                 for (int x = 0; x < width; x++) {
                     if (maskp[x] == 10)
                         dstp[x] = srcp[x];
@@ -801,7 +789,7 @@ static void eDeint(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef *
                 prvp += stride;
                 srcp += stride;
                 nxtp += stride;
-                maskp += stride;
+                maskp += maskStride;
                 edeintp += stride;
                 dstp += stride;
             }
@@ -811,24 +799,26 @@ static void eDeint(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef *
 
 template<typename T>
 static void cubicDeint(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef * prv, const VSFrameRef * src, const VSFrameRef * nxt,
-                       const TDeintModData * d, const VSAPI * vsapi) noexcept {
+                       const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
         if (d->process[plane]) {
             const int width = vsapi->getFrameWidth(src, plane);
             const int height = vsapi->getFrameHeight(src, plane);
             const int stride = vsapi->getStride(src, plane) / sizeof(T);
-            const T * prvp = reinterpret_cast<const T *>(vsapi->getReadPtr(prv, plane));
-            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
-            const T * nxtp = reinterpret_cast<const T *>(vsapi->getReadPtr(nxt, plane));
-            const T * maskp = reinterpret_cast<const T *>(vsapi->getReadPtr(mask, plane));
-            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane));
+            const int maskStride = vsapi->getStride(mask, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T * prvp = reinterpret_cast<const T *>(vsapi->getReadPtr(prv, plane)) + stride * rows.first;
+            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            const T * nxtp = reinterpret_cast<const T *>(vsapi->getReadPtr(nxt, plane)) + stride * rows.first;
+            const uint8_t * maskp = vsapi->getReadPtr(mask, plane) + maskStride * rows.first;
+            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane)) + stride * rows.first;
 
             const T * srcpp = srcp - stride;
             const T * srcppp = srcpp - stride * 2;
             const T * srcpn = srcp + stride;
             const T * srcpnn = srcpn + stride * 2;
 
-            for (int y = 0; y < height; y++) {
+            for (int y = rows.first; y < rows.second; y++) {
                 for (int x = 0; x < width; x++) {
                     if (maskp[x] == 10)
                         dstp[x] = srcp[x];
@@ -863,7 +853,7 @@ static void cubicDeint(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameR
                 srcpn += stride;
                 srcpnn += stride;
                 nxtp += stride;
-                maskp += stride;
+                maskp += maskStride;
                 dstp += stride;
             }
         }
@@ -871,99 +861,130 @@ static void cubicDeint(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameR
 }
 
 template<typename T>
-static void binaryMask(const VSFrameRef * src, VSFrameRef * dst, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+static void binaryMask(const VSFrameRef * src, VSFrameRef * dst, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
         if (d->process[plane]) {
             const int width = vsapi->getFrameWidth(src, plane);
             const int height = vsapi->getFrameHeight(src, plane);
-            const int stride = vsapi->getStride(src, plane) / sizeof(T);
-            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
-            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane));
+            const int srcStride = vsapi->getStride(src, plane);
+            const int dstStride = vsapi->getStride(dst, plane) / sizeof(T);
+            const auto rows = stripRows(height, strip, d);
+            const uint8_t * srcp = vsapi->getReadPtr(src, plane) + srcStride * rows.first;
+            T * VS_RESTRICT dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane)) + dstStride * rows.first;
 
-            for (int y = 0; y < height; y++) {
+            for (int y = rows.first; y < rows.second; y++) {
                 for (int x = 0; x < width; x++)
                     dstp[x] = (srcp[x] == 60) ? d->peak : 0;
 
-                srcp += stride;
-                dstp += stride;
+                srcp += srcStride;
+                dstp += dstStride;
             }
         }
     }
 }
 
 static void selectFunctions(const unsigned opt, TDeintModData * d) noexcept {
-#if defined(VS_TARGET_CPU_X86) || defined(__ARM_NEON__)
+#ifdef VS_TARGET_CPU_X86
     const int iset = instrset_detect();
 #endif
 
+    const int ssw = d->vi.format->subSamplingW;
+    const int ssh = d->vi.format->subSamplingH;
+
+    // the masks are 8-bit whatever the source depth
+    d->buildMask = buildMask;
+    d->setMaskForUpsize = setMaskForUpsize;
+    d->expandMask = expandMask;
+    d->linkMask = ssw ? (ssh ? linkMask<1, 1> : linkMask<1, 0>) : (ssh ? linkMask<0, 1> : linkMask<0, 0>);
+
+#ifdef VS_TARGET_CPU_X86
+    if ((opt == 0 && iset >= 8) || opt == 3 || opt == 4) {
+        d->expandMask = expandMask_avx2;
+        d->linkMask = ssw ? (ssh ? linkMask_avx2<1, 1> : linkMask_avx2<1, 0>) : (ssh ? linkMask_avx2<0, 1> : linkMask_avx2<0, 0>);
+    } else if ((opt == 0 && iset >= 2) || opt == 2) {
+        d->expandMask = expandMask_sse2;
+        d->linkMask = ssw ? (ssh ? linkMask_sse2<1, 1> : linkMask_sse2<1, 0>) : (ssh ? linkMask_sse2<0, 1> : linkMask_sse2<0, 0>);
+    }
+#endif
+
+    // the padding has to cover the overread of one full vector past the right edge
+    d->widthPad = 32 / d->vi.format->bytesPerSample;
+
     if (d->vi.format->bytesPerSample == 1) {
         d->copyPad = copyPad<uint8_t>;
         d->threshMask = threshMask_c<uint8_t>;
-        d->motionMask = motionMask_c<uint8_t>;
-        d->andMasks = andMasks_c<uint8_t>;
-        d->combineMasks = combineMasks_c<uint8_t>;
-        d->buildMask = buildMask<uint8_t>;
-        d->setMaskForUpsize = setMaskForUpsize<uint8_t>;
+        d->packMotion = packMotion_c<uint8_t>;
         d->checkSpatial = checkSpatial<uint8_t>;
-        d->expandMask = expandMask<uint8_t>;
-        d->linkMask = linkMask<uint8_t>;
         d->eDeint = eDeint<uint8_t>;
         d->cubicDeint = cubicDeint<uint8_t>;
         d->binaryMask = binaryMask<uint8_t>;
 
 #if defined(VS_TARGET_CPU_X86)
-        if ((opt == 0 && iset >= 8) || opt == 3) {
+        if ((opt == 0 && iset >= 10) || opt == 4) {
+            d->threshMask = threshMask_avx512<uint8_t, Vec64uc, 64>;
+            d->packMotion = packMotion_avx512<uint8_t, Vec64uc, 64>;
+            d->checkSpatial = checkSpatial_avx2<uint8_t, Vec32uc, Vec16s, 32>;
+            d->eDeint = eDeint_avx2<uint8_t, Vec32uc, 32>;
+            d->cubicDeint = cubicDeint_avx2<uint8_t, Vec32uc, 32>;
+            d->widthPad = 64;
+        } else if ((opt == 0 && iset >= 8) || opt == 3) {
             d->threshMask = threshMask_avx2<uint8_t, Vec32uc, 32>;
-            d->motionMask = motionMask_avx2<uint8_t, Vec32uc, 32>;
-            d->andMasks = andMasks_avx2<uint8_t, Vec32uc, 32>;
-            d->combineMasks = combineMasks_avx2<uint8_t, Vec32uc, 32>;
+            d->packMotion = packMotion_avx2<uint8_t, Vec32uc, 32>;
+            d->checkSpatial = checkSpatial_avx2<uint8_t, Vec32uc, Vec16s, 32>;
+            d->eDeint = eDeint_avx2<uint8_t, Vec32uc, 32>;
+            d->cubicDeint = cubicDeint_avx2<uint8_t, Vec32uc, 32>;
         } else if ((opt == 0 && iset >= 2) || opt == 2) {
             d->threshMask = threshMask_sse2<uint8_t, Vec16uc, 16>;
-            d->motionMask = motionMask_sse2<uint8_t, Vec16uc, 16>;
-            d->andMasks = andMasks_sse2<uint8_t, Vec16uc, 16>;
-            d->combineMasks = combineMasks_sse2<uint8_t, Vec16uc, 16>;
+            d->packMotion = packMotion_sse2<uint8_t, Vec16uc, 16>;
+            d->checkSpatial = checkSpatial_sse2<uint8_t, Vec16uc, Vec8s, 16>;
+            d->eDeint = eDeint_sse2<uint8_t, Vec16uc, 16>;
+            d->cubicDeint = cubicDeint_sse2<uint8_t, Vec16uc, 16>;
         }
-#elif defined(__ARM_NEON__)
-        if ((opt == 0 && iset >= 2) || opt == 2) {
-            d->threshMask = threshMask_sse2<uint8_t, Vec16uc, 16>;
-            d->motionMask = motionMask_sse2<uint8_t, Vec16uc, 16>;
-            d->andMasks = andMasks_sse2<uint8_t, Vec16uc, 16>;
-            d->combineMasks = combineMasks_sse2<uint8_t, Vec16uc, 16>;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        // Advanced SIMD is part of every AArch64 core, so opt only chooses between it and plain c here
+        if (opt == 0 || opt == 2) {
+            d->threshMask = threshMask_neon<uint8_t>;
+            d->packMotion = packMotion_neon<uint8_t>;
+            d->eDeint = eDeint_neon<uint8_t>;
+            d->cubicDeint = cubicDeint_neon<uint8_t>;
         }
 #endif
     } else {
         d->copyPad = copyPad<uint16_t>;
         d->threshMask = threshMask_c<uint16_t>;
-        d->motionMask = motionMask_c<uint16_t>;
-        d->andMasks = andMasks_c<uint16_t>;
-        d->combineMasks = combineMasks_c<uint16_t>;
-        d->buildMask = buildMask<uint16_t>;
-        d->setMaskForUpsize = setMaskForUpsize<uint16_t>;
+        d->packMotion = packMotion_c<uint16_t>;
         d->checkSpatial = checkSpatial<uint16_t>;
-        d->expandMask = expandMask<uint16_t>;
-        d->linkMask = linkMask<uint16_t>;
         d->eDeint = eDeint<uint16_t>;
         d->cubicDeint = cubicDeint<uint16_t>;
         d->binaryMask = binaryMask<uint16_t>;
 
 #ifdef VS_TARGET_CPU_X86
-        if ((opt == 0 && iset >= 8) || opt == 3) {
+        if ((opt == 0 && iset >= 10) || opt == 4) {
+            d->threshMask = threshMask_avx512<uint16_t, Vec32us, 32>;
+            d->packMotion = packMotion_avx512<uint16_t, Vec32us, 32>;
+            d->checkSpatial = checkSpatial_avx2<uint16_t, Vec16us, Vec8i, 16>;
+            d->eDeint = eDeint_avx2<uint16_t, Vec16us, 16>;
+            d->cubicDeint = cubicDeint_avx2<uint16_t, Vec16us, 16>;
+            d->widthPad = 32;
+        } else if ((opt == 0 && iset >= 8) || opt == 3) {
             d->threshMask = threshMask_avx2<uint16_t, Vec16us, 16>;
-            d->motionMask = motionMask_avx2<uint16_t, Vec16us, 16>;
-            d->andMasks = andMasks_avx2<uint16_t, Vec16us, 16>;
-            d->combineMasks = combineMasks_avx2<uint16_t, Vec16us, 16>;
+            d->packMotion = packMotion_avx2<uint16_t, Vec16us, 16>;
+            d->checkSpatial = checkSpatial_avx2<uint16_t, Vec16us, Vec8i, 16>;
+            d->eDeint = eDeint_avx2<uint16_t, Vec16us, 16>;
+            d->cubicDeint = cubicDeint_avx2<uint16_t, Vec16us, 16>;
         } else if ((opt == 0 && iset >= 2) || opt == 2) {
             d->threshMask = threshMask_sse2<uint16_t, Vec8us, 8>;
-            d->motionMask = motionMask_sse2<uint16_t, Vec8us, 8>;
-            d->andMasks = andMasks_sse2<uint16_t, Vec8us, 8>;
-            d->combineMasks = combineMasks_sse2<uint16_t, Vec8us, 8>;
+            d->packMotion = packMotion_sse2<uint16_t, Vec8us, 8>;
+            d->checkSpatial = checkSpatial_sse2<uint16_t, Vec8us, Vec4i, 8>;
+            d->eDeint = eDeint_sse2<uint16_t, Vec8us, 8>;
+            d->cubicDeint = cubicDeint_sse2<uint16_t, Vec8us, 8>;
         }
-#elif defined(__ARM_NEON__)
-        if ((opt == 0 && iset >= 2) || opt == 2) {
-            d->threshMask = threshMask_sse2<uint16_t, Vec8us, 8>;
-            d->motionMask = motionMask_sse2<uint16_t, Vec8us, 8>;
-            d->andMasks = andMasks_sse2<uint16_t, Vec8us, 8>;
-            d->combineMasks = combineMasks_sse2<uint16_t, Vec8us, 8>;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+        if (opt == 0 || opt == 2) {
+            d->threshMask = threshMask_neon<uint16_t>;
+            d->packMotion = packMotion_neon<uint16_t>;
+            d->eDeint = eDeint_neon<uint16_t>;
+            d->cubicDeint = cubicDeint_neon<uint16_t>;
         }
 #endif
     }
@@ -974,151 +995,200 @@ static void VS_CC tdeintmodInit(VSMap *in, VSMap *out, void **instanceData, VSNo
     vsapi->setVideoInfo(&d->vi, 1, node);
 }
 
-static const VSFrameRef *VS_CC tdeintmodCreateMMGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    const TDeintModData * d = static_cast<const TDeintModData *>(*instanceData);
+// Runs task(0) .. task(count - 1), spread over the strip pool when there is one. Returns once all of them are done.
+static void parallelFor(const TDeintModData * d, const int count, const std::function<void(int)> & task) {
+    if (d->pool) {
+        d->pool->run(count, task);
+    } else {
+        for (int i = 0; i < count; i++)
+            task(i);
+    }
+}
 
-    if (activationReason == arInitial) {
-        for (int i = n; i <= std::min(n + 2, d->vi.numFrames - 1); i++)
-            vsapi->requestFrameFilter(i, d->node, frameCtx);
-    } else if (activationReason == arAllFramesReady) {
-        const VSFrameRef * src[3];
-        VSFrameRef * pad[3], * msk[3][2];
-        for (int i = 0; i < 3; i++) {
-            src[i] = vsapi->getFrameFilter(std::min(n + i, d->vi.numFrames - 1), d->node, frameCtx);
-            pad[i] = vsapi->newVideoFrame(d->format, d->vi.width + d->widthPad * 2, d->vi.height, nullptr, core);
-            msk[i][0] = vsapi->newVideoFrame(d->format, d->vi.width + d->widthPad * 2, d->vi.height * 2, nullptr, core);
-            msk[i][1] = vsapi->newVideoFrame(d->format, d->vi.width + d->widthPad * 2, d->vi.height * 2, nullptr, core);
-        }
-        VSFrameRef * dst[] = { vsapi->newVideoFrame(d->format, d->vi.width + d->widthPad * 2, d->vi.height * 2, nullptr, core),
-                               vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, nullptr, core) };
+// Runs task(plane, strip) for every strip of every processed plane
+static void forEachStrip(const TDeintModData * d, const std::function<void(int, int)> & task) {
+    parallelFor(d, d->vi.format->numPlanes * d->strips, [&](const int i) {
+        const int plane = i / d->strips;
+        if (d->process[plane])
+            task(plane, i % d->strips);
+    });
+}
 
+// TMM stage for field `parity` of source frames n to n + 2, returned bit-packed. The fields are read straight out of the source
+// frames. The padded fields with their threshold masks, the motion masks between adjacent fields and the result all go through
+// small caches keyed by frame number and parity, since the neighbouring output frames need them too.
+static const VSFrameRef * createMM(const int n, const int parity, VSFrameContext * frameCtx, VSCore * core, const TDeintModData * d, const VSAPI * vsapi) {
+    const VSFrameRef * dst;
+    if (d->mmCache->get(n * 2 + parity, &dst, vsapi))
+        return dst;
+
+    const int numFrames = d->viSaved->numFrames;
+    const int height = d->vi.height / 2;
+
+    // fld[i] holds the padded field in [0, 3) and its threshold mask in [3, 6), mot[i] the packed motion mask between fields n + i and n + i + 1
+    const VSFrameRef * fld[3][6] = {}, * mot[2] = {};
+
+    for (int i = 0; i < 3; i++) {
+        const int k = std::min(n + i, numFrames - 1);
+        if (d->fieldCache->get(k * 2 + parity, fld[i], vsapi))
+            continue;
+
+        const VSFrameRef * src = vsapi->getFrameFilter(k, d->node, frameCtx);
+        VSFrameRef * pad[3] = {}, * msk[3] = {};
         for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
             if (d->process[plane]) {
-                for (int i = 0; i < 3; i++) {
-                    d->copyPad(src[i], pad[i], plane, d->widthPad, vsapi);
-                    d->threshMask(pad[i], msk[i][0], plane, d, vsapi);
-                }
-                for (int i = 0; i < 2; i++)
-                    d->motionMask(pad[i], msk[i][0], pad[i + 1], msk[i + 1][0], msk[i][1], plane, d, vsapi);
-                d->motionMask(pad[0], msk[0][0], pad[2], msk[2][0], dst[0], plane, d, vsapi);
-                d->andMasks(msk[0][1], msk[1][1], dst[0], plane, d, vsapi);
-                d->combineMasks(dst[0], dst[1], plane, d, vsapi);
+                pad[plane] = vsapi->newVideoFrame(d->format, d->vi.width + d->widthPad * 2, height, nullptr, core);
+                msk[plane] = vsapi->newVideoFrame(d->format, d->vi.width + d->widthPad * 2, height * 2, nullptr, core);
             }
         }
-
-        for (int i = 0; i < 3; i++) {
-            vsapi->freeFrame(src[i]);
-            vsapi->freeFrame(pad[i]);
-            vsapi->freeFrame(msk[i][0]);
-            vsapi->freeFrame(msk[i][1]);
+        // the padding of a plane has to be complete before any strip of its threshold mask reads it
+        parallelFor(d, d->vi.format->numPlanes, [&](const int plane) {
+            if (d->process[plane])
+                d->copyPad(src, pad[plane], plane, parity, d->widthPad, vsapi);
+        });
+        forEachStrip(d, [&](const int plane, const int strip) {
+            d->threshMask(pad[plane], msk[plane], plane, strip, d, vsapi);
+        });
+        for (int plane = 0; plane < 3; plane++) {
+            fld[i][plane] = pad[plane];
+            fld[i][plane + 3] = msk[plane];
         }
-        vsapi->freeFrame(dst[0]);
-        return dst[1];
+        vsapi->freeFrame(src);
+        d->fieldCache->put(k * 2 + parity, fld[i], vsapi);
     }
 
-    return nullptr;
-}
+    for (int i = 0; i < 2; i++) {
+        const int k = std::min(n + i, numFrames - 1);
+        if (d->pairCache->get(k * 2 + parity, &mot[i], vsapi))
+            continue;
+
+        VSFrameRef * msk = vsapi->newVideoFrame(d->bitFormat, d->bitWidth, height * 2, nullptr, core);
+        forEachStrip(d, [&](const int plane, const int strip) {
+            motionMask(fld[i][plane], fld[i][plane + 3], fld[i + 1][plane], fld[i + 1][plane + 3], msk, plane, strip, d, vsapi);
+        });
+        mot[i] = msk;
+        d->pairCache->put(k * 2 + parity, &mot[i], vsapi);
+    }
 
-static const VSFrameRef *VS_CC tdeintmodBuildMMGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
-    const TDeintModData * d = static_cast<const TDeintModData *>(*instanceData);
+    VSFrameRef * mm = vsapi->newVideoFrame(d->bitFormat, d->bitWidth, height, nullptr, core);
 
-    if (activationReason == arInitial) {
-        if (d->mode == 1)
-            n /= 2;
+    forEachStrip(d, [&](const int plane, const int strip) {
+        combineMasks(fld[0][plane], fld[0][plane + 3], fld[2][plane], fld[2][plane + 3], mot[0], mot[1], mm, plane, strip, d, vsapi);
+    });
 
-        const int start = std::max(n - 1 - (d->length - 2) / 2, 0);
-        const int stop = std::min(n + 1 + (d->length - 2) / 2 - 2, d->viSaved->numFrames - 3);
-        for (int i = start; i <= stop; i++) {
-            vsapi->requestFrameFilter(i, d->node, frameCtx);
-            vsapi->requestFrameFilter(i, d->node2, frameCtx);
-        }
+    for (int i = 0; i < 3; i++) {
+        for (auto frame : fld[i])
+            vsapi->freeFrame(frame);
+    }
+    for (int i = 0; i < 2; i++)
+        vsapi->freeFrame(mot[i]);
 
-        vsapi->requestFrameFilter(n, d->propNode, frameCtx);
-    } else if (activationReason == arAllFramesReady) {
-        const int nSaved = n;
-        if (d->mode == 1)
-            n /= 2;
+    d->mmCache->put(n * 2 + parity, &mm, vsapi);
+    return mm;
+}
 
-        int err;
-        const VSFrameRef * propSrc = vsapi->getFrameFilter(n, d->propNode, frameCtx);
-        const int fieldBased = int64ToIntS(vsapi->propGetInt(vsapi->getFramePropsRO(propSrc), "_FieldBased", 0, &err));
-        vsapi->freeFrame(propSrc);
+// Range of TMM stages read for output frame n. It is empty when the clip is too short for any.
+static std::pair<int, int> tmmWindow(const int n, const TDeintModData * d) noexcept {
+    return { std::max(n - 1 - (d->length - 2) / 2, 0), std::min(n + 1 + (d->length - 2) / 2 - 2, d->viSaved->numFrames - 3) };
+}
 
-        int order = d->order;
-        if (fieldBased == 1)
-            order = 0;
-        else if (fieldBased == 2)
-            order = 1;
+// Source frames needed for output frame n: its neighbours, plus every frame read by the TMM stages around it
+static std::pair<int, int> frameWindow(const int n, const TDeintModData * d) noexcept {
+    const int numFrames = d->viSaved->numFrames;
+    int first = std::max(n - 1, 0);
+    int last = std::min(n + 1, numFrames - 1);
+
+    if (d->tmm) {
+        const auto window = tmmWindow(n, d);
+        if (window.first <= window.second) {
+            first = std::min(first, window.first);
+            last = std::max(last, window.second + 2);
+        }
+    }
 
-        int field;
-        if (d->mode == 1)
-            field = (nSaved & 1) ? 1 - order : order;
-        else
-            field = (d->field == -1) ? order : d->field;
+    return { first, last };
+}
 
-        VSFrameRef ** srct = new VSFrameRef *[d->length - 2];
-        VSFrameRef ** srcb = new VSFrameRef *[d->length - 2];
-        VSFrameRef * dst = vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, nullptr, core);
-
-        int tStart, tStop, bStart, bStop, cCount, oCount;
-        VSFrameRef ** cSrc, ** oSrc;
-        if (field == 1) {
-            tStart = n - (d->length - 1) / 2;
-            tStop = n + (d->length - 1) / 2 - 2;
-            const int bn = (order == 1) ? n - 1 : n;
-            bStart = bn - (d->length - 2) / 2;
-            bStop = bn + 1 + (d->length - 2) / 2 - 2;
-            oCount = tStop - tStart + 1;
-            cCount = bStop - bStart + 1;
-            oSrc = srct;
-            cSrc = srcb;
-        } else {
-            const int tn = (order == 0) ? n - 1 : n;
-            tStart = tn - (d->length - 2) / 2;
-            tStop = tn + 1 + (d->length - 2) / 2 - 2;
-            bStart = n - (d->length - 1) / 2;
-            bStop = n + (d->length - 1) / 2 - 2;
-            cCount = tStop - tStart + 1;
-            oCount = bStop - bStart + 1;
-            cSrc = srct;
-            oSrc = srcb;
-        }
+static void buildMM(VSFrameRef * dst, const int n, const int order, const int field, VSFrameContext * frameCtx, VSCore * core, const TDeintModData * d,
+                    const VSAPI * vsapi) {
+    // keep everything this frame reads out of the way of eviction until it is done
+    const auto window = tmmWindow(n, d);
+    const auto fieldPin = d->fieldCache->pin(window.first * 2, window.second * 2 + 5);
+    const auto pairPin = d->pairCache->pin(window.first * 2, window.second * 2 + 3);
+    const auto mmPin = d->mmCache->pin(window.first * 2, window.second * 2 + 1);
+
+    auto scratch = d->scratch->scope();
+    const VSFrameRef ** srct = scratch.alloc<const VSFrameRef *>(d->length - 2);
+    const VSFrameRef ** srcb = scratch.alloc<const VSFrameRef *>(d->length - 2);
+
+    int tStart, tStop, bStart, bStop, cCount, oCount;
+    const VSFrameRef ** cSrc, ** oSrc;
+    if (field == 1) {
+        tStart = n - (d->length - 1) / 2;
+        tStop = n + (d->length - 1) / 2 - 2;
+        const int bn = (order == 1) ? n - 1 : n;
+        bStart = bn - (d->length - 2) / 2;
+        bStop = bn + 1 + (d->length - 2) / 2 - 2;
+        oCount = tStop - tStart + 1;
+        cCount = bStop - bStart + 1;
+        oSrc = srct;
+        cSrc = srcb;
+    } else {
+        const int tn = (order == 0) ? n - 1 : n;
+        tStart = tn - (d->length - 2) / 2;
+        tStop = tn + 1 + (d->length - 2) / 2 - 2;
+        bStart = n - (d->length - 1) / 2;
+        bStop = n + (d->length - 1) / 2 - 2;
+        cCount = tStop - tStart + 1;
+        oCount = bStop - bStart + 1;
+        cSrc = srct;
+        oSrc = srcb;
+    }
 
-        for (int i = tStart; i <= tStop; i++) {
-            if (i < 0 || i >= d->viSaved->numFrames - 2) {
-                srct[i - tStart] = vsapi->newVideoFrame(d->viSaved->format, d->viSaved->width, d->viSaved->height, nullptr, core);
-                for (int plane = 0; plane < d->viSaved->format->numPlanes; plane++)
-                    memset(vsapi->getWritePtr(srct[i - tStart], plane), 0, vsapi->getStride(srct[i - tStart], plane) * vsapi->getFrameHeight(srct[i - tStart], plane));
-            } else {
-                const VSFrameRef * src = vsapi->getFrameFilter(i, d->node, frameCtx);
-                srct[i - tStart] = vsapi->copyFrame(src, core);
-                vsapi->freeFrame(src);
-            }
+    for (int i = tStart; i <= tStop; i++) {
+        if (i < 0 || i >= d->viSaved->numFrames - 2) {
+            srct[i - tStart] = vsapi->cloneFrameRef(d->zeroField);
+        } else {
+            srct[i - tStart] = createMM(i, 0, frameCtx, core, d, vsapi);
         }
-        for (int i = bStart; i <= bStop; i++) {
-            if (i < 0 || i >= d->viSaved->numFrames - 2) {
-                srcb[i - bStart] = vsapi->newVideoFrame(d->viSaved->format, d->viSaved->width, d->viSaved->height, nullptr, core);
-                for (int plane = 0; plane < d->viSaved->format->numPlanes; plane++)
-                    memset(vsapi->getWritePtr(srcb[i - bStart], plane), 0, vsapi->getStride(srcb[i - bStart], plane) * vsapi->getFrameHeight(srcb[i - bStart], plane));
-            } else {
-                const VSFrameRef * src = vsapi->getFrameFilter(i, d->node2, frameCtx);
-                srcb[i - bStart] = vsapi->copyFrame(src, core);
-                vsapi->freeFrame(src);
-            }
+    }
+    for (int i = bStart; i <= bStop; i++) {
+        if (i < 0 || i >= d->viSaved->numFrames - 2) {
+            srcb[i - bStart] = vsapi->cloneFrameRef(d->zeroField);
+        } else {
+            srcb[i - bStart] = createMM(i, 1, frameCtx, core, d, vsapi);
         }
+    }
 
-        d->buildMask(cSrc, oSrc, dst, cCount, oCount, order, field, d, vsapi);
+    parallelFor(d, d->strips, [&](const int strip) {
+        d->buildMask(cSrc, oSrc, dst, cCount, oCount, order, field, strip, d, vsapi);
+    });
 
-        for (int i = tStart; i <= tStop; i++)
-            vsapi->freeFrame(srct[i - tStart]);
-        for (int i = bStart; i <= bStop; i++)
-            vsapi->freeFrame(srcb[i - bStart]);
-        delete[] srct;
-        delete[] srcb;
-        return dst;
-    }
+    for (int i = tStart; i <= tStop; i++)
+        vsapi->freeFrame(srct[i - tStart]);
+    for (int i = bStart; i <= bStop; i++)
+        vsapi->freeFrame(srcb[i - bStart]);
+}
 
-    return nullptr;
+// Requests everything that output frame nSaved, made from source frame n, reads
+static void requestFrames(const int n, const int nSaved, VSFrameContext * frameCtx, const TDeintModData * d, const VSAPI * vsapi) {
+    const auto window = frameWindow(n, d);
+    for (int i = window.first; i <= window.second; i++)
+        vsapi->requestFrameFilter(i, d->node, frameCtx);
+
+    if (!d->show && d->edeint)
+        vsapi->requestFrameFilter(nSaved, d->edeint, frameCtx);
+}
+
+static void halveDuration(VSMap * props, const VSAPI * vsapi) {
+    int errNum, errDen;
+    int64_t durationNum = vsapi->propGetInt(props, "_DurationNum", 0, &errNum);
+    int64_t durationDen = vsapi->propGetInt(props, "_DurationDen", 0, &errDen);
+    if (!errNum && !errDen) {
+        muldivRational(&durationNum, &durationDen, 1, 2);
+        vsapi->propSetInt(props, "_DurationNum", durationNum, paReplace);
+        vsapi->propSetInt(props, "_DurationDen", durationDen, paReplace);
+    }
 }
 
 static const VSFrameRef *VS_CC tdeintmodGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -1129,22 +1199,73 @@ static const VSFrameRef *VS_CC tdeintmodGetFrame(int n, int activationReason, vo
         if (d->mode == 1)
             n /= 2;
 
-        if (n > 0)
-            vsapi->requestFrameFilter(n - 1, d->node, frameCtx);
-        vsapi->requestFrameFilter(n, d->node, frameCtx);
-        if (n < d->viSaved->numFrames - 1)
-            vsapi->requestFrameFilter(n + 1, d->node, frameCtx);
-
-        if (d->mask)
-            vsapi->requestFrameFilter(nSaved, d->mask, frameCtx);
-
-        if (!d->show && d->edeint)
-            vsapi->requestFrameFilter(nSaved, d->edeint, frameCtx);
+        // with full=False the rest is only requested once the source frame turns out to be combed
+        if (d->combed)
+            vsapi->requestFrameFilter(n, d->node, frameCtx);
+        else
+            requestFrames(n, nSaved, frameCtx, d, vsapi);
     } else if (activationReason == arAllFramesReady) {
         const int nSaved = n;
         if (d->mode == 1)
             n /= 2;
 
+        if (d->combed && !*frameData) {
+            const VSFrameRef * src = vsapi->getFrameFilter(n, d->node, frameCtx);
+
+            // in mode 1 both fields of a source frame ask in turn, so the second one takes the verdict of the first
+            int64_t combed;
+            const int64_t last = d->lastCombed ? d->lastCombed->load() : -1;
+            if (last >= 0 && last / 2 == n) {
+                combed = last & 1;
+            } else {
+                combed = isCombed(src, nullptr, nullptr, d->combed, vsapi);
+                if (combed < 0) {
+                    vsapi->setFilterError("TDeintMod: malloc failure (scratch)", frameCtx);
+                    vsapi->freeFrame(src);
+                    return nullptr;
+                }
+
+                if (d->lastCombed)
+                    d->lastCombed->store(static_cast<int64_t>(n) * 2 + combed);
+            }
+
+            if (!combed) {
+                // show gets an empty mask rather than the picture, so the clip does not switch between the two
+                if (d->show) {
+                    VSFrameRef * dst = vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, src, core);
+                    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+                        if (d->process[plane])
+                            memset(vsapi->getWritePtr(dst, plane), 0, vsapi->getStride(dst, plane) * vsapi->getFrameHeight(dst, plane));
+                    }
+
+                    VSMap * props = vsapi->getFramePropsRW(dst);
+                    vsapi->propSetInt(props, "_FieldBased", 0, paReplace);
+
+                    if (d->mode == 1)
+                        halveDuration(props, vsapi);
+
+                    vsapi->freeFrame(src);
+                    return dst;
+                }
+
+                if (d->mode == 0)
+                    return src;
+
+                // the copy shares the planes of src, only the duration differs
+                VSFrameRef * dst = vsapi->copyFrame(src, core);
+                halveDuration(vsapi->getFramePropsRW(dst), vsapi);
+                vsapi->freeFrame(src);
+                return dst;
+            }
+
+            vsapi->freeFrame(src);
+            requestFrames(n, nSaved, frameCtx, d, vsapi);
+
+            // non-null tells the next call that the frame was found combed and everything it reads has been requested
+            *frameData = d->combed;
+            return nullptr;
+        }
+
         const VSFrameRef * prv = vsapi->getFrameFilter(std::max(n - 1, 0), d->node, frameCtx);
         const VSFrameRef * src = vsapi->getFrameFilter(n, d->node, frameCtx);
         const VSFrameRef * nxt = vsapi->getFrameFilter(std::min(n + 1, d->viSaved->numFrames - 1), d->node, frameCtx);
@@ -1167,51 +1288,42 @@ static const VSFrameRef *VS_CC tdeintmodGetFrame(int n, int activationReason, vo
         else
             field = (d->field == -1) ? order : d->field;
 
-        if (d->mask) {
-            mask = const_cast<VSFrameRef *>(vsapi->getFrameFilter(nSaved, d->mask, frameCtx));
-        } else {
-            mask = vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, nullptr, core);
-            d->setMaskForUpsize(mask, field, d, vsapi);
-        }
+        mask = vsapi->newVideoFrame(d->maskFormat, d->vi.width, d->vi.height, nullptr, core);
+        if (d->tmm)
+            buildMM(mask, n, order, field, frameCtx, core, d, vsapi);
+        else
+            parallelFor(d, d->strips, [&](const int strip) { d->setMaskForUpsize(mask, field, strip, d, vsapi); });
 
         if (d->athresh > -1)
-            d->checkSpatial(src, mask, d, vsapi);
+            parallelFor(d, d->strips, [&](const int strip) { d->checkSpatial(src, mask, strip, d, vsapi); });
 
         if (d->expand)
-            d->expandMask(mask, field, d, vsapi);
+            parallelFor(d, d->strips, [&](const int strip) { d->expandMask(mask, field, strip, d, vsapi); });
 
         if (d->link)
-            d->linkMask(mask, field, d, vsapi);
+            parallelFor(d, d->strips, [&](const int strip) { d->linkMask(mask, field, strip, d, vsapi); });
 
         if (!d->show) {
             dst = vsapi->newVideoFrame2(d->vi.format, d->vi.width, d->vi.height, fr, pl, src, core);
 
             if (d->edeint) {
                 const VSFrameRef * edeint = vsapi->getFrameFilter(nSaved, d->edeint, frameCtx);
-                d->eDeint(dst, mask, prv, src, nxt, edeint, d, vsapi);
+                parallelFor(d, d->strips, [&](const int strip) { d->eDeint(dst, mask, prv, src, nxt, edeint, strip, d, vsapi); });
                 vsapi->freeFrame(edeint);
             } else {
-                d->cubicDeint(dst, mask, prv, src, nxt, d, vsapi);
+                parallelFor(d, d->strips, [&](const int strip) { d->cubicDeint(dst, mask, prv, src, nxt, strip, d, vsapi); });
             }
         } else {
             dst = vsapi->newVideoFrame(d->vi.format, d->vi.width, d->vi.height, src, core);
 
-            d->binaryMask(mask, dst, d, vsapi);
+            parallelFor(d, d->strips, [&](const int strip) { d->binaryMask(mask, dst, strip, d, vsapi); });
         }
 
         VSMap * props = vsapi->getFramePropsRW(dst);
         vsapi->propSetInt(props, "_FieldBased", 0, paReplace);
 
-        if (d->mode == 1) {
-            int errNum, errDen;
-            int64_t durationNum = vsapi->propGetInt(props, "_DurationNum", 0, &errNum);
-            int64_t durationDen = vsapi->propGetInt(props, "_DurationDen", 0, &errDen);
-            if (!errNum && !errDen) {
-                muldivRational(&durationNum, &durationDen, 1, 2);
-                vsapi->propSetInt(props, "_DurationNum", durationNum, paReplace);
-                vsapi->propSetInt(props, "_DurationDen", durationDen, paReplace);
-            }
-        }
+        if (d->mode == 1)
+            halveDuration(props, vsapi);
 
         vsapi->freeFrame(prv);
         vsapi->freeFrame(src);
@@ -1223,26 +1335,30 @@ static const VSFrameRef *VS_CC tdeintmodGetFrame(int n, int activationReason, vo
     return nullptr;
 }
 
-static void VS_CC tdeintmodCreateMMFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
-    TDeintModData * d = static_cast<TDeintModData *>(instanceData);
-    vsapi->freeNode(d->node);
-    delete d;
-}
-
-static void VS_CC tdeintmodBuildMMFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
-    TDeintModData * d = static_cast<TDeintModData *>(instanceData);
-    vsapi->freeNode(d->node);
-    vsapi->freeNode(d->node2);
-    vsapi->freeNode(d->propNode);
-    delete[] d->gvlut;
-    delete d;
-}
-
 static void VS_CC tdeintmodFree(void *instanceData, VSCore *core, const VSAPI *vsapi) {
     TDeintModData * d = static_cast<TDeintModData *>(instanceData);
     vsapi->freeNode(d->node);
-    vsapi->freeNode(d->mask);
     vsapi->freeNode(d->edeint);
+
+    if (d->tmm) {
+        d->fieldCache->clear(vsapi);
+        d->pairCache->clear(vsapi);
+        d->mmCache->clear(vsapi);
+        delete d->fieldCache;
+        delete d->pairCache;
+        delete d->mmCache;
+        vsapi->freeFrame(d->zeroField);
+        delete[] d->gvlut;
+    }
+
+    if (d->combed) {
+        freeCombed(d->combed);
+        delete d->combed;
+        delete d->lastCombed;
+    }
+
+    delete d->scratch;
+    delete d->pool;
     delete d;
 }
 
@@ -1318,6 +1434,16 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
 
     const int opt = int64ToIntS(vsapi->propGetInt(in, "opt", 0, &err));
 
+    const int cacheMB = int64ToIntS(vsapi->propGetInt(in, "cache_mb", 0, &err));
+
+    int threads = int64ToIntS(vsapi->propGetInt(in, "threads", 0, &err));
+    if (err)
+        threads = 1;
+
+    bool full = !!vsapi->propGetInt(in, "full", 0, &err);
+    if (err)
+        full = true;
+
     if (d.order < 0 || d.order > 1) {
         vsapi->setError(out, "TDeintMod: order must be 0 or 1");
         return;
@@ -1398,8 +1524,18 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
         return;
     }
 
-    if (opt < 0 || opt > 3) {
-        vsapi->setError(out, "TDeintMod: opt must be 0, 1, 2 or 3");
+    if (opt < 0 || opt > 4) {
+        vsapi->setError(out, "TDeintMod: opt must be 0, 1, 2, 3 or 4");
+        return;
+    }
+
+    if (cacheMB < 0) {
+        vsapi->setError(out, "TDeintMod: cache_mb must be greater than or equal to 0");
+        return;
+    }
+
+    if (threads < 1) {
+        vsapi->setError(out, "TDeintMod: threads must be greater than or equal to 1");
         return;
     }
 
@@ -1468,7 +1604,7 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
     selectFunctions(opt, &d);
 
     d.format = vsapi->registerFormat(cmGray, stInteger, d.vi.format->bitsPerSample, 0, 0, core);
-    d.widthPad = 32 / d.vi.format->bytesPerSample;
+    d.maskFormat = vsapi->registerFormat(d.vi.format->colorFamily, stInteger, 8, d.vi.format->subSamplingW, d.vi.format->subSamplingH, core);
     d.peak = (1 << d.vi.format->bitsPerSample) - 1;
 
     if (d.mtqL > -2 || d.mthL > -2 || d.mtqC > -2 || d.mthC > -2) {
@@ -1491,81 +1627,10 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
             d.vHalf[plane] = 1 << (d.vShift[plane] - 1);
         }
 
-        VSMap * args = vsapi->createMap();
-        VSPlugin * stdPlugin = vsapi->getPluginById("com.vapoursynth.std", core);
-
-        vsapi->propSetNode(args, "clip", d.node, paReplace);
-        vsapi->freeNode(d.node);
-        vsapi->propSetData(args, "prop", "_FieldBased", -1, paReplace);
-        vsapi->propSetInt(args, "intval", 2, paReplace);
-        VSMap * ret = vsapi->invoke(stdPlugin, "SetFrameProp", args);
-        d.node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->clearMap(args);
-        vsapi->freeMap(ret);
-
-        vsapi->propSetNode(args, "clip", d.node, paReplace);
-        vsapi->freeNode(d.node);
-        vsapi->propSetInt(args, "tff", 1, paReplace);
-        ret = vsapi->invoke(stdPlugin, "SeparateFields", args);
-        VSNodeRef * separated = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->clearMap(args);
-        vsapi->freeMap(ret);
-
-        vsapi->propSetNode(args, "clip", separated, paReplace);
-        vsapi->propSetInt(args, "cycle", 2, paReplace);
-        vsapi->propSetInt(args, "offsets", 0, paReplace);
-        ret = vsapi->invoke(stdPlugin, "SelectEvery", args);
-        d.node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        d.vi = *vsapi->getVideoInfo(d.node);
-        vsapi->clearMap(args);
-        vsapi->freeMap(ret);
-
-        TDeintModData * data = new TDeintModData{ d };
-
-        vsapi->createFilter(in, out, "TDeintMod", tdeintmodInit, tdeintmodCreateMMGetFrame, tdeintmodCreateMMFree, fmParallel, 0, data, core);
-        VSNodeRef * temp = vsapi->propGetNode(out, "clip", 0, nullptr);
-        vsapi->propSetNode(args, "clip", temp, paReplace);
-        vsapi->freeNode(temp);
-        ret = vsapi->invoke(stdPlugin, "Cache", args);
-        temp = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->clearMap(out);
-        vsapi->clearMap(args);
-        vsapi->freeMap(ret);
-
-        vsapi->propSetNode(args, "clip", separated, paReplace);
-        vsapi->freeNode(separated);
-        vsapi->propSetInt(args, "cycle", 2, paReplace);
-        vsapi->propSetInt(args, "offsets", 1, paReplace);
-        ret = vsapi->invoke(stdPlugin, "SelectEvery", args);
-        d.node = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        d.vi = *vsapi->getVideoInfo(d.node);
-        vsapi->clearMap(args);
-        vsapi->freeMap(ret);
-
-        data = new TDeintModData{ d };
-
-        vsapi->createFilter(in, out, "TDeintMod", tdeintmodInit, tdeintmodCreateMMGetFrame, tdeintmodCreateMMFree, fmParallel, 0, data, core);
-        d.node2 = vsapi->propGetNode(out, "clip", 0, nullptr);
-        vsapi->propSetNode(args, "clip", d.node2, paReplace);
-        vsapi->freeNode(d.node2);
-        ret = vsapi->invoke(stdPlugin, "Cache", args);
-        d.node2 = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->clearMap(out);
-        vsapi->clearMap(args);
-        vsapi->freeMap(ret);
-
-        d.node = temp;
-        d.propNode = vsapi->propGetNode(in, "clip", 0, nullptr);
-        d.vi = *vsapi->getVideoInfo(d.node);
-        d.viSaved = vsapi->getVideoInfo(d.node);
-
-        d.vi.height *= 2;
-        if (d.mode == 1)
-            d.vi.numFrames *= 2;
-
-        d.gvlut = new uint8_t[d.length];
-        for (int i = 0; i < d.length; i++)
-            d.gvlut[i] = (i == 0) ? 1 : (i == d.length - 1 ? 4 : 2);
+        // the TMM stage works on bit-packed masks, one bit per pixel in every plane
+        d.bitFormat = vsapi->registerFormat(d.vi.format->numPlanes == 1 ? cmGray : cmYUV, stInteger, 8, 0, 0, core);
+        d.bitWidth = (d.vi.width + 63) / 64 * 8;
+        d.tmm = true;
 
         if (d.mtype == 0) {
             d.vlut = {
@@ -1606,28 +1671,14 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
             60, 20, 50, 10, 60, 10, 40, 30,
             60, 10, 40, 30, 60, 20, 50, 10
         };
-
-        data = new TDeintModData{ d };
-
-        vsapi->createFilter(in, out, "TDeintMod", tdeintmodInit, tdeintmodBuildMMGetFrame, tdeintmodBuildMMFree, fmParallel, 0, data, core);
-        d.mask = vsapi->propGetNode(out, "clip", 0, nullptr);
-        vsapi->propSetNode(args, "clip", d.mask, paReplace);
-        vsapi->freeNode(d.mask);
-        ret = vsapi->invoke(stdPlugin, "Cache", args);
-        d.mask = vsapi->propGetNode(ret, "clip", 0, nullptr);
-        vsapi->clearMap(out);
-        vsapi->freeMap(args);
-        vsapi->freeMap(ret);
     }
 
     if (d.athresh > -1) {
         d.athresh = d.athresh * d.peak / 255;
         d.athresh6 = d.athresh * 6;
-        d.athreshsq = d.athresh * d.athresh;
+        d.athreshsq = static_cast<int64_t>(d.athresh) * d.athresh;
     }
 
-    if (d.mask)
-        d.node = vsapi->propGetNode(in, "clip", 0, nullptr);
     d.edeint = vsapi->propGetNode(in, "edeint", 0, &err);
     d.vi = *vsapi->getVideoInfo(d.node);
     d.viSaved = vsapi->getVideoInfo(d.node);
@@ -1636,7 +1687,6 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
         if (d.vi.numFrames > INT_MAX / 2) {
             vsapi->setError(out, "TDeintMod: resulting clip is too long");
             vsapi->freeNode(d.node);
-            vsapi->freeNode(d.mask);
             vsapi->freeNode(d.edeint);
             return;
         }
@@ -1650,7 +1700,6 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
         if (!isSameFormat(vsapi->getVideoInfo(d.edeint), &d.vi)) {
             vsapi->setError(out, "TDeintMod: edeint clip must have the same dimensions as main clip and be the same format");
             vsapi->freeNode(d.node);
-            vsapi->freeNode(d.mask);
             vsapi->freeNode(d.edeint);
             return;
         }
@@ -1658,12 +1707,99 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
         if (vsapi->getVideoInfo(d.edeint)->numFrames != d.vi.numFrames) {
             vsapi->setError(out, "TDeintMod: edeint clip's number of frames doesn't match");
             vsapi->freeNode(d.node);
-            vsapi->freeNode(d.mask);
             vsapi->freeNode(d.edeint);
             return;
         }
     }
 
+    if (!full) {
+        std::unique_ptr<IsCombedData> combed{ new IsCombedData{} };
+        combed->vi = vsapi->getVideoInfo(d.node);
+        combed->metric = { d.metric };
+
+        const int cthresh = int64ToIntS(vsapi->propGetInt(in, "cthresh", 0, &err));
+        combed->cthresh = { err ? 6 : cthresh };
+
+        combed->blockx = int64ToIntS(vsapi->propGetInt(in, "blockx", 0, &err));
+        if (err)
+            combed->blockx = 16;
+
+        combed->blocky = int64ToIntS(vsapi->propGetInt(in, "blocky", 0, &err));
+        if (err)
+            combed->blocky = 16;
+
+        combed->chroma = !!vsapi->propGetInt(in, "chroma", 0, &err);
+
+        const int MI = int64ToIntS(vsapi->propGetInt(in, "mi", 0, &err));
+        combed->MI = { err ? 64 : MI };
+
+        try {
+            initCombed(combed.get(), opt, core, vsapi);
+        } catch (const std::string & error) {
+            vsapi->setError(out, ("TDeintMod: " + error).c_str());
+            vsapi->freeNode(d.node);
+            vsapi->freeNode(d.edeint);
+            return;
+        }
+
+        d.combed = combed.release();
+
+        if (d.mode == 1)
+            d.lastCombed = new std::atomic<int64_t>{ -1 };
+    }
+
+    if (d.tmm) {
+        VSFrameRef * zeroField = vsapi->newVideoFrame(d.bitFormat, d.bitWidth, d.vi.height / 2, nullptr, core);
+        for (int plane = 0; plane < d.bitFormat->numPlanes; plane++)
+            memset(vsapi->getWritePtr(zeroField, plane), 0, vsapi->getStride(zeroField, plane) * vsapi->getFrameHeight(zeroField, plane));
+        d.zeroField = zeroField;
+
+        d.gvlut = new uint8_t[d.length];
+        for (int i = 0; i < d.length; i++)
+            d.gvlut[i] = (i == 0) ? 1 : (i == d.length - 1 ? 4 : 2);
+
+        // enough entries for every worker thread to be on a different output frame at once, for both field parities
+        const int numThreads = vsapi->getCoreInfo(core)->numThreads;
+        size_t fieldEntries = static_cast<size_t>(numThreads + 2) * 2;
+        size_t pairEntries = static_cast<size_t>(numThreads + 1) * 2;
+        size_t mmEntries = static_cast<size_t>(d.length - 2 + numThreads) * 2;
+
+        if (cacheMB) {
+            // Shrink the caches to the budget, the padded fields first since they are by far the largest entries. One output
+            // frame's worth of every kind is always kept, or each frame would rebuild its whole window.
+            int processed = 0;
+            for (int plane = 0; plane < d.vi.format->numPlanes; plane++)
+                processed += d.process[plane];
+
+            const size_t fieldBytes = static_cast<size_t>(d.vi.width + d.widthPad * 2) * (d.vi.height / 2) * 3 * d.vi.format->bytesPerSample * processed;
+            const size_t pairBytes = static_cast<size_t>(d.bitWidth) * d.vi.height * d.bitFormat->numPlanes;
+            const size_t mmBytes = pairBytes / 2;
+            const size_t budget = static_cast<size_t>(cacheMB) << 20;
+
+            size_t total = fieldEntries * fieldBytes + pairEntries * pairBytes + mmEntries * mmBytes;
+            auto shrink = [&](size_t & entries, const size_t minEntries, const size_t bytes) {
+                while (total > budget && entries > minEntries) {
+                    entries--;
+                    total -= bytes;
+                }
+            };
+            shrink(fieldEntries, 3, fieldBytes);
+            shrink(pairEntries, 2, pairBytes);
+            shrink(mmEntries, static_cast<size_t>(d.length - 2) * 2, mmBytes);
+        }
+
+        d.fieldCache = new TMMCache{ fieldEntries, 6 };
+        d.pairCache = new TMMCache{ pairEntries, 1 };
+        d.mmCache = new TMMCache{ mmEntries, 1 };
+    }
+
+    // every frame thread and strip helper may hold a scope while buildMM holds its own
+    d.scratch = new ScratchArena{ static_cast<size_t>(vsapi->getCoreInfo(core)->numThreads + threads) * 2 };
+
+    // a couple of strips per thread evens out the load when the rows are not equally expensive
+    d.strips = (threads > 1) ? threads * 2 : 1;
+    d.pool = (threads > 1) ? new StripPool{ threads } : nullptr;
+
     TDeintModData * data = new TDeintModData{ d };
 
     vsapi->createFilter(in, out, "TDeintMod", tdeintmodInit, tdeintmodGetFrame, tdeintmodFree, fmParallel, 0, data, core);
@@ -1672,360 +1808,510 @@ static void VS_CC tdeintmodCreate(const VSMap *in, VSMap *out, void *userData, V
 //////////////////////////////////////////
 // IsCombed
 
-struct IsCombedData {
-    VSNodeRef * node;
-    const VSVideoInfo * vi;
-    int cthresh, blockx, blocky, MI, metric;
-    bool chroma;
-    int cthresh6, cthreshsq, xHalf, yHalf, xShift, yShift, arraySize, xBlocks4, widtha, heighta;
-    std::unordered_map<std::thread::id, int *> cArray;
-};
-
 static bool isPowerOf2(const int i) noexcept {
     return i && !(i & (i - 1));
 }
 
+#ifdef VS_TARGET_CPU_X86
+template<typename T1, typename T2, typename T3, int step> extern void combRow_sse2(const uint8_t *, const int, const int, const int, const int, uint8_t * const *, const IsCombedData *) noexcept;
+template<typename T1, typename T2, typename T3, int step> extern void combRow_avx2(const uint8_t *, const int, const int, const int, const int, uint8_t * const *, const IsCombedData *) noexcept;
+
+template<typename T1, typename T2, typename T3, int step, int ssw> extern void linkRow_sse2(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+template<typename T1, typename T2, typename T3, int step, int ssw> extern void linkRow_avx2(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+
+template<typename T1, typename T2, int step> extern void countBand_sse2(const uint8_t * const *, const int, const int, uint16_t *) noexcept;
+template<typename T1, typename T2, int step> extern void countBand_avx2(const uint8_t * const *, const int, const int, uint16_t *) noexcept;
+#endif
+
+// Comb masks of row y of a plane, one in dstRows for every entry of d->masks
 template<typename T>
-static int64_t checkCombed(const VSFrameRef * src, VSFrameRef * cmask, const IsCombedData * d, const VSAPI * vsapi) noexcept {
+static void combRow(const uint8_t * srcRow, const int srcStride, const int y, const int height, const int width, uint8_t * const * dstRows, const IsCombedData * d) noexcept {
     constexpr T peak = std::numeric_limits<T>::max();
 
-    int * VS_RESTRICT cArray = d->cArray.at(std::this_thread::get_id());
+    const int stride = srcStride / sizeof(T);
+    const T * srcp = reinterpret_cast<const T *>(srcRow);
+
+    // rows past the top and bottom are mirrored
+    const T * srcppp = srcp + stride * (y > 1 ? -2 : 2);
+    const T * srcpp = srcp + stride * (y > 0 ? -1 : 1);
+    const T * srcpn = srcp + stride * (y < height - 1 ? 1 : -1);
+    const T * srcpnn = srcp + stride * (y < height - 2 ? 2 : -2);
+
+    const CombMask * masks = d->masks.data();
+    const int count = static_cast<int>(d->masks.size());
+    const bool cubic = std::any_of(masks, masks + count, [](const CombMask & m) { return m.metric == 0; });
+    const bool product = std::any_of(masks, masks + count, [](const CombMask & m) { return m.metric == 1; });
+
+    // the differences, the five-tap sum and the product are worked out once per run of pixels and shared by every mask
+    constexpr int run = 256;
+    int low[run], high[run], sum[run];
+    // the product of two 16-bit differences does not fit in int
+    int64_t prod[run];
+
+    for (int first = 0; first < width; first += run) {
+        const int n = std::min(run, width - first);
+        const T * VS_RESTRICT s = srcp + first;
+        const T * VS_RESTRICT spp = srcpp + first;
+        const T * VS_RESTRICT spn = srcpn + first;
+
+        for (int x = 0; x < n; x++) {
+            const int sFirst = s[x] - spp[x];
+            const int sSecond = s[x] - spn[x];
+            low[x] = std::min(sFirst, sSecond);
+            high[x] = std::max(sFirst, sSecond);
+        }
 
-    for (int plane = 0; plane < (d->chroma ? 3 : 1); plane++) {
-        const int width = vsapi->getFrameWidth(src, plane);
-        const int height = vsapi->getFrameHeight(src, plane);
-        const int stride = vsapi->getStride(src, plane) / sizeof(T);
-        const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane));
-        T * VS_RESTRICT cmkp = reinterpret_cast<T *>(vsapi->getWritePtr(cmask, plane));
+        if (cubic) {
+            const T * VS_RESTRICT sppp = srcppp + first;
+            const T * VS_RESTRICT spnn = srcpnn + first;
+            for (int x = 0; x < n; x++)
+                sum[x] = std::abs(sppp[x] + s[x] * 4 + spnn[x] - 3 * (spp[x] + spn[x]));
+        }
 
-        const T * srcppp = srcp - stride * 2;
-        const T * srcpp = srcp - stride;
-        const T * srcpn = srcp + stride;
-        const T * srcpnn = srcp + stride * 2;
+        if (product) {
+            for (int x = 0; x < n; x++)
+                prod[x] = static_cast<int64_t>(s[x] - spp[x]) * (s[x] - spn[x]);
+        }
 
-        memset(cmkp, 0, vsapi->getStride(cmask, plane) * height);
+        for (int k = 0; k < count; k++) {
+            const CombMask & m = masks[k];
+            T * VS_RESTRICT cmkp = reinterpret_cast<T *>(dstRows[k]) + first;
 
-        if (d->metric == 0) {
-            for (int x = 0; x < width; x++) {
-                const int sFirst = srcp[x] - srcpn[x];
-                if ((sFirst > d->cthresh || sFirst < -d->cthresh) && std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpn[x] + srcpn[x])) > d->cthresh6)
-                    cmkp[x] = peak;
-            }
-            srcppp += stride;
-            srcpp += stride;
-            srcp += stride;
-            srcpn += stride;
-            srcpnn += stride;
-            cmkp += stride;
-
-            for (int x = 0; x < width; x++) {
-                const int sFirst = srcp[x] - srcpp[x];
-                const int sSecond = srcp[x] - srcpn[x];
-                if (((sFirst > d->cthresh && sSecond > d->cthresh) || (sFirst < -d->cthresh && sSecond < -d->cthresh)) &&
-                    std::abs(srcpnn[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->cthresh6)
-                    cmkp[x] = peak;
-            }
-            srcppp += stride;
-            srcpp += stride;
-            srcp += stride;
-            srcpn += stride;
-            srcpnn += stride;
-            cmkp += stride;
-
-            for (int y = 2; y < height - 2; y++) {
-                for (int x = 0; x < width; x++) {
-                    const int sFirst = srcp[x] - srcpp[x];
-                    const int sSecond = srcp[x] - srcpn[x];
-                    if (((sFirst > d->cthresh && sSecond > d->cthresh) || (sFirst < -d->cthresh && sSecond < -d->cthresh)) &&
-                        std::abs(srcppp[x] + srcp[x] * 4 + srcpnn[x] - 3 * (srcpp[x] + srcpn[x])) > d->cthresh6)
-                        cmkp[x] = peak;
-                }
-                srcppp += stride;
-                srcpp += stride;
-                srcp += stride;
-                srcpn += stride;
-                srcpnn += stride;
-                cmkp += stride;
+            if (m.metric == 0) {
+                const int cthresh = m.cthresh;
+                const int cthresh6 = m.cthresh6;
+                for (int x = 0; x < n; x++)
+                    cmkp[x] = (((low[x] > cthresh) | (high[x] < -cthresh)) & (sum[x] > cthresh6)) ? peak : 0;
+            } else {
+                const int64_t cthreshsq = m.cthreshsq;
+                for (int x = 0; x < n; x++)
+                    cmkp[x] = (prod[x] > cthreshsq) ? peak : 0;
             }
+        }
+    }
+}
 
-            for (int x = 0; x < width; x++) {
-                const int sFirst = srcp[x] - srcpp[x];
-                const int sSecond = srcp[x] - srcpn[x];
-                if (((sFirst > d->cthresh && sSecond > d->cthresh) || (sFirst < -d->cthresh && sSecond < -d->cthresh)) &&
-                    std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpn[x])) > d->cthresh6)
-                    cmkp[x] = peak;
-            }
-            srcppp += stride;
-            srcpp += stride;
-            srcp += stride;
-            srcpn += stride;
-            srcpnn += stride;
-            cmkp += stride;
-
-            for (int x = 0; x < width; x++) {
-                const int sFirst = srcp[x] - srcpp[x];
-                if ((sFirst > d->cthresh || sFirst < -d->cthresh) && std::abs(srcppp[x] + srcp[x] * 4 + srcppp[x] - 3 * (srcpp[x] + srcpp[x])) > d->cthresh6)
-                    cmkp[x] = peak;
-            }
-        } else {
-            for (int x = 0; x < width; x++) {
-                if ((srcp[x] - srcpn[x]) * (srcp[x] - srcpn[x]) > d->cthreshsq)
-                    cmkp[x] = peak;
-            }
-            srcpp += stride;
-            srcp += stride;
-            srcpn += stride;
-            cmkp += stride;
+// A chroma pixel of either plane that is combed along with one of its eight neighbours marks every luma pixel it covers.
+// rowsU and rowsV are the chroma mask rows above, at and below the linked row, luma are the count luma mask rows it marks.
+template<typename T>
+static void linkRow(const uint8_t * const * rowsU, const uint8_t * const * rowsV, const int width, uint8_t * const * luma, const int count, const IsCombedData * d) noexcept {
+    constexpr T peak = std::numeric_limits<T>::max();
 
-            for (int y = 1; y < height - 1; y++) {
-                for (int x = 0; x < width; x++) {
-                    if ((srcp[x] - srcpp[x]) * (srcp[x] - srcpn[x]) > d->cthreshsq)
-                        cmkp[x] = peak;
+    const int ssw = d->vi->format->subSamplingW;
+    const T * cmkppU = reinterpret_cast<const T *>(rowsU[0]);
+    const T * cmkpU = reinterpret_cast<const T *>(rowsU[1]);
+    const T * cmkpnU = reinterpret_cast<const T *>(rowsU[2]);
+    const T * cmkppV = reinterpret_cast<const T *>(rowsV[0]);
+    const T * cmkpV = reinterpret_cast<const T *>(rowsV[1]);
+    const T * cmkpnV = reinterpret_cast<const T *>(rowsV[2]);
+
+    for (int x = 1; x < width - 1; x++) {
+        if ((cmkpU[x] && (cmkpU[x - 1] || cmkpU[x + 1] || cmkppU[x - 1] || cmkppU[x] || cmkppU[x + 1] || cmkpnU[x - 1] || cmkpnU[x] || cmkpnU[x + 1])) ||
+            (cmkpV[x] && (cmkpV[x - 1] || cmkpV[x + 1] || cmkppV[x - 1] || cmkppV[x] || cmkppV[x + 1] || cmkpnV[x - 1] || cmkpnV[x] || cmkpnV[x + 1]))) {
+            for (int i = 0; i < count; i++)
+                std::fill_n(reinterpret_cast<T *>(luma[i]) + (x << ssw), 1 << ssw, peak);
+        }
+    }
+}
+
+// Counts, for every column, the pixels of a band that are combed together with the pixels above and below.
+// rows holds the mask row above the band, the count rows of the band and the row below it.
+template<typename T>
+static void countBand(const uint8_t * const * rows, const int count, const int width, uint16_t * VS_RESTRICT columns) noexcept {
+    std::fill_n(columns, width, 0);
+
+    for (int y = 0; y < count; y++) {
+        const T * cmkpp = reinterpret_cast<const T *>(rows[y]);
+        const T * cmkp = reinterpret_cast<const T *>(rows[y + 1]);
+        const T * cmkpn = reinterpret_cast<const T *>(rows[y + 2]);
+
+        for (int x = 0; x < width; x++) {
+            if (cmkpp[x] && cmkp[x] && cmkpn[x])
+                columns[x]++;
+        }
+    }
+}
+
+// The comb masks are never built for the whole frame. They are made a band of yHalf rows at a time into rings of rows that hold
+// just what the band and the chroma rows linked into it read. With stop set, counting ends once every mask has a block over the
+// highest MI, otherwise every block is counted. The luma rows of the first mask go straight into the mask frame when one is given.
+// The highest block count of every mask is left in scratch->MIC.
+template<typename T>
+static void checkCombed(const VSFrameRef * src, VSFrameRef * mask, IsCombedScratch * scratch, const bool stop, const IsCombedData * d, const VSAPI * vsapi) noexcept {
+    const int masks = static_cast<int>(d->masks.size());
+    int * VS_RESTRICT MIC = scratch->MIC;
+
+    const int width = vsapi->getFrameWidth(src, 0);
+    const int height = vsapi->getFrameHeight(src, 0);
+    const int stride = vsapi->getStride(src, 0);
+    const uint8_t * srcp = vsapi->getReadPtr(src, 0);
+
+    const int ssh = d->vi->format->subSamplingH;
+    const int widthUV = d->chroma ? vsapi->getFrameWidth(src, 1) : 0;
+    const int heightUV = d->chroma ? vsapi->getFrameHeight(src, 1) : 0;
+    const int strideUV = d->chroma ? vsapi->getStride(src, 1) : 0;
+    const uint8_t * srcpUV[3] = { nullptr, d->chroma ? vsapi->getReadPtr(src, 1) : nullptr, d->chroma ? vsapi->getReadPtr(src, 2) : nullptr };
+
+    uint8_t * maskp = mask ? vsapi->getWritePtr(mask, 0) : nullptr;
+    const int maskStride = mask ? vsapi->getStride(mask, 0) : 0;
+
+    // every mask has its own rings, one after another
+    const size_t ringSize = static_cast<size_t>(d->pitch) * d->ringRows;
+    const size_t ringSizeUV = static_cast<size_t>(d->pitchUV) * 3;
+
+    const auto lumaRow = [&](const int k, const int y) {
+        return (mask && k == 0) ? maskp + maskStride * y : scratch->ring[0] + ringSize * k + d->pitch * (y % d->ringRows);
+    };
+    const auto chromaRow = [&](const int plane, const int k, const int y) { return scratch->ring[plane] + ringSizeUV * k + d->pitchUV * (y % 3); };
+
+    // block counts only ever go up, so a mask with a block over the highest MI is combed for every MI
+    const auto done = [&](const int k) { return stop && MIC[k] > d->maxMI; };
+
+    memset(scratch->cArray, 0, d->arraySize * masks * sizeof(int));
+    std::fill_n(MIC, masks, 0);
+
+    int masked = 0;   // luma rows [0, masked) have their comb masks
+    int maskedUV = 0; // same for chroma rows
+    int linked = 1;   // chroma rows [1, linked) are linked into the luma masks
+    int left = masks; // masks that are not done
+
+    // Rows 1 to height - 2 are counted in bands of yHalf rows and every band is summed over half blocks of xHalf columns.
+    // A half block lies in the four overlapping blocks made of it and its neighbours to the left, above and above left.
+    for (int band = 0; band * d->yHalf < height - 1; band++) {
+        const int first = std::max(band * d->yHalf, 1);
+        const int last = std::min((band + 1) * d->yHalf, height - 1);
+        int maskEnd = last + 1;
+        int linkEnd = linked;
+
+        if (d->chroma) {
+            // a chroma row marks luma rows from three above to two below its top luma row, every one of them has to be masked before
+            linkEnd = std::min(((last + 3) >> ssh) + 1, heightUV - 1);
+            maskEnd = std::max(maskEnd, std::min(((linkEnd - 1) << ssh) + 3, height));
+        }
+
+        // the masks of a row are made together, so the source row is only read once for all of them
+        for (; masked < maskEnd; masked++) {
+            for (int k = 0; k < masks; k++)
+                scratch->maskRows[k] = lumaRow(k, masked);
+            d->combRow(srcp + stride * masked, stride, masked, height, width, scratch->maskRows, d);
+        }
+
+        for (; linked < linkEnd; linked++) {
+            for (; maskedUV <= linked + 1; maskedUV++) {
+                for (int plane = 1; plane < 3; plane++) {
+                    for (int k = 0; k < masks; k++)
+                        scratch->maskRows[k] = chromaRow(plane, k, maskedUV);
+                    d->combRow(srcpUV[plane] + strideUV * maskedUV, strideUV, maskedUV, heightUV, widthUV, scratch->maskRows, d);
                 }
-                srcpp += stride;
-                srcp += stride;
-                srcpn += stride;
-                cmkp += stride;
             }
 
-            for (int x = 0; x < width; x++) {
-                if ((srcp[x] - srcpp[x]) * (srcp[x] - srcpp[x]) > d->cthreshsq)
-                    cmkp[x] = peak;
+            int rows[5];
+            const int count = chromaRows(linked, ssh, rows);
+
+            for (int k = 0; k < masks; k++) {
+                if (done(k))
+                    continue;
+
+                uint8_t * luma[5];
+                for (int i = 0; i < count; i++)
+                    luma[i] = lumaRow(k, rows[i]);
+
+                const uint8_t * rowsU[3] = { chromaRow(1, k, linked - 1), chromaRow(1, k, linked), chromaRow(1, k, linked + 1) };
+                const uint8_t * rowsV[3] = { chromaRow(2, k, linked - 1), chromaRow(2, k, linked), chromaRow(2, k, linked + 1) };
+                d->linkRow(rowsU, rowsV, widthUV, luma, count, d);
             }
         }
-    }
 
-    if (d->chroma) {
-        const int width = vsapi->getFrameWidth(cmask, 2);
-        const int height = vsapi->getFrameHeight(cmask, 2);
-        const int stride = vsapi->getStride(cmask, 0) / sizeof(T);
-        const int strideY = stride << d->vi->format->subSamplingH;
-        const int strideUV = vsapi->getStride(cmask, 2) / sizeof(T);
-        T * VS_RESTRICT cmkp = reinterpret_cast<T *>(vsapi->getWritePtr(cmask, 0));
-        const T * cmkpU = reinterpret_cast<const T *>(vsapi->getReadPtr(cmask, 1));
-        const T * cmkpV = reinterpret_cast<const T *>(vsapi->getReadPtr(cmask, 2));
-
-        T * VS_RESTRICT cmkpp3 = cmkp - stride * 3;
-        T * VS_RESTRICT cmkpp2 = cmkp - stride * 2;
-        T * VS_RESTRICT cmkpp = cmkp - stride;
-        T * VS_RESTRICT cmkpn = cmkp + stride;
-        T * VS_RESTRICT cmkpn2 = cmkp + stride * 2;
-        const T * cmkppU = cmkpU - strideUV;
-        const T * cmkpnU = cmkpU + strideUV;
-        const T * cmkppV = cmkpV - strideUV;
-        const T * cmkpnV = cmkpV + strideUV;
-
-        for (int y = 1; y < height - 1; y++) {
-            cmkpp3 += strideY;
-            cmkpp2 += strideY;
-            cmkpp += strideY;
-            cmkp += strideY;
-            cmkpn += strideY;
-            cmkpn2 += strideY;
-            cmkppU += strideUV;
-            cmkpU += strideUV;
-            cmkpnU += strideUV;
-            cmkppV += strideUV;
-            cmkpV += strideUV;
-            cmkpnV += strideUV;
-
-            for (int x = 1; x < width - 1; x++) {
-                if ((cmkpU[x] && (cmkpU[x - 1] || cmkpU[x + 1] || cmkppU[x - 1] || cmkppU[x] || cmkppU[x + 1] || cmkpnU[x - 1] || cmkpnU[x] || cmkpnU[x + 1])) ||
-                    (cmkpV[x] && (cmkpV[x - 1] || cmkpV[x + 1] || cmkppV[x - 1] || cmkppV[x] || cmkppV[x + 1] || cmkpnV[x - 1] || cmkpnV[x] || cmkpnV[x + 1]))) {
-                    if (d->vi->format->subSamplingW == 0) {
-                        cmkp[x] = peak;
-
-                        if (d->vi->format->subSamplingH > 0) {
-                            cmkpn[x] = peak;
-                            (y & 1 ? cmkpp : cmkpn2)[x] = peak;
-
-                            if (d->vi->format->subSamplingH == 2) {
-                                cmkpp2[x] = peak;
-                                (y & 1 ? cmkpp3 : cmkpp)[x] = peak;
-                            }
-                        }
-                    } else if (d->vi->format->subSamplingW == 1) {
-                        if (std::is_same<T, uint8_t>::value) {
-                            constexpr uint16_t peak2 = std::numeric_limits<uint16_t>::max();
-                            reinterpret_cast<uint16_t *>(cmkp)[x] = peak2;
-
-                            if (d->vi->format->subSamplingH > 0) {
-                                reinterpret_cast<uint16_t *>(cmkpn)[x] = peak2;
-                                reinterpret_cast<uint16_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
-
-                                if (d->vi->format->subSamplingH == 2) {
-                                    reinterpret_cast<uint16_t *>(cmkpp2)[x] = peak2;
-                                    reinterpret_cast<uint16_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
-                                }
-                            }
-                        } else {
-                            constexpr uint32_t peak2 = std::numeric_limits<uint32_t>::max();
-                            reinterpret_cast<uint32_t *>(cmkp)[x] = peak2;
-
-                            if (d->vi->format->subSamplingH > 0) {
-                                reinterpret_cast<uint32_t *>(cmkpn)[x] = peak2;
-                                reinterpret_cast<uint32_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
-
-                                if (d->vi->format->subSamplingH == 2) {
-                                    reinterpret_cast<uint32_t *>(cmkpp2)[x] = peak2;
-                                    reinterpret_cast<uint32_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
-                                }
-                            }
-                        }
-                    } else {
-                        if (std::is_same<T, uint8_t>::value) {
-                            constexpr uint32_t peak2 = std::numeric_limits<uint32_t>::max();
-                            reinterpret_cast<uint32_t *>(cmkp)[x] = peak2;
-
-                            if (d->vi->format->subSamplingH > 0) {
-                                reinterpret_cast<uint32_t *>(cmkpn)[x] = peak2;
-                                reinterpret_cast<uint32_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
-
-                                if (d->vi->format->subSamplingH == 2) {
-                                    reinterpret_cast<uint32_t *>(cmkpp2)[x] = peak2;
-                                    reinterpret_cast<uint32_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
-                                }
-                            }
-                        } else {
-                            constexpr uint64_t peak2 = std::numeric_limits<uint64_t>::max();
-                            reinterpret_cast<uint64_t *>(cmkp)[x] = peak2;
-
-                            if (d->vi->format->subSamplingH > 0) {
-                                reinterpret_cast<uint64_t *>(cmkpn)[x] = peak2;
-                                reinterpret_cast<uint64_t *>(y & 1 ? cmkpp : cmkpn2)[x] = peak2;
-
-                                if (d->vi->format->subSamplingH == 2) {
-                                    reinterpret_cast<uint64_t *>(cmkpp2)[x] = peak2;
-                                    reinterpret_cast<uint64_t *>(y & 1 ? cmkpp3 : cmkpp)[x] = peak2;
-                                }
-                            }
-                        }
+        const int temp1 = (band >> 1) * d->xBlocks4;
+        const int temp2 = ((band + 1) >> 1) * d->xBlocks4;
+
+        for (int k = 0; k < masks; k++) {
+            if (done(k))
+                continue;
+
+            int * VS_RESTRICT cArray = scratch->cArray + d->arraySize * k;
+
+            for (int y = first - 1; y <= last; y++)
+                scratch->bandRows[y - first + 1] = lumaRow(k, y);
+            d->countBand(scratch->bandRows, last - first, width, scratch->columns);
+
+            for (int half = 0; half * d->xHalf < width; half++) {
+                const int x = half * d->xHalf;
+                int sum = 0;
+
+                for (int v = x; v < std::min(x + d->xHalf, width); v++)
+                    sum += scratch->columns[v];
+
+                if (sum) {
+                    const int box1 = (half >> 1) * 4;
+                    const int box2 = ((half + 1) >> 1) * 4;
+
+                    for (const int box : { temp1 + box1, temp1 + box2 + 1, temp2 + box1 + 2, temp2 + box2 + 3 }) {
+                        cArray[box] += sum;
+                        MIC[k] = std::max(MIC[k], cArray[box]);
                     }
                 }
             }
+
+            if (done(k) && --left == 0)
+                return;
         }
     }
+}
+
+static IsCombedScratch * newScratch(const IsCombedData * d) noexcept {
+    const auto align = [](const size_t size) { return (size + 63) & ~static_cast<size_t>(63); };
+    const size_t masks = d->masks.size();
+
+    const size_t sizes[] = {
+        align(sizeof(IsCombedScratch)),
+        align(d->arraySize * masks * sizeof(int)),
+        align(masks * sizeof(int)),
+        align(d->vi->width) * sizeof(uint16_t), // room for the whole last vector of a row
+        d->blocks ? align(d->arraySize * sizeof(uint16_t)) : 0,
+        align((d->yHalf + 2) * sizeof(const uint8_t *)),
+        align(masks * sizeof(uint8_t *)),
+        static_cast<size_t>(d->pitch) * d->ringRows * masks,
+        static_cast<size_t>(d->pitchUV) * 3 * masks,
+        static_cast<size_t>(d->pitchUV) * 3 * masks
+    };
+
+    size_t total = 0;
+    for (auto size : sizes)
+        total += size;
+
+    uint8_t * buffer = vs_aligned_malloc<uint8_t>(total, 64);
+    if (!buffer)
+        return nullptr;
+
+    IsCombedScratch * scratch = reinterpret_cast<IsCombedScratch *>(buffer);
+    buffer += sizes[0];
+    scratch->cArray = reinterpret_cast<int *>(buffer);
+    buffer += sizes[1];
+    scratch->MIC = reinterpret_cast<int *>(buffer);
+    buffer += sizes[2];
+    scratch->columns = reinterpret_cast<uint16_t *>(buffer);
+    buffer += sizes[3];
+    scratch->blocks = reinterpret_cast<uint16_t *>(buffer);
+    buffer += sizes[4];
+    scratch->bandRows = reinterpret_cast<const uint8_t **>(buffer);
+    buffer += sizes[5];
+    scratch->maskRows = reinterpret_cast<uint8_t **>(buffer);
+    buffer += sizes[6];
+    for (int plane = 0; plane < 3; plane++) {
+        scratch->ring[plane] = buffer;
+        buffer += sizes[7 + plane];
+    }
+    return scratch;
+}
 
-    const int width = vsapi->getFrameWidth(cmask, 0);
-    const int height = vsapi->getFrameHeight(cmask, 0);
-    const int stride = vsapi->getStride(cmask, 0) / sizeof(T);
-    const T * cmkp = reinterpret_cast<const T *>(vsapi->getReadPtr(cmask, 0)) + stride;
+static void selectFunctions(const unsigned opt, IsCombedData * d) noexcept {
+#ifdef VS_TARGET_CPU_X86
+    const int iset = instrset_detect();
 
-    const T * cmkpp = cmkp - stride;
-    const T * cmkpn = cmkp + stride;
+    const int ssw = d->vi->format->subSamplingW;
 
-    memset(cArray, 0, d->arraySize * sizeof(int));
+    // the last vector of a chroma row is moved back inside the row, so the row has to hold one vector and the two edge pixels
+    const int chromaWidth = d->vi->width >> ssw;
+#endif
 
-    for (int y = 1; y < d->yHalf; y++) {
-        const int temp1 = (y >> d->yShift) * d->xBlocks4;
-        const int temp2 = ((y + d->yHalf) >> d->yShift) * d->xBlocks4;
+    if (d->vi->format->bytesPerSample == 1) {
+        d->combRow = combRow<uint8_t>;
+        d->linkRow = linkRow<uint8_t>;
+        d->countBand = countBand<uint8_t>;
 
-        for (int x = 0; x < width; x++) {
-            if (cmkpp[x] && cmkp[x] && cmkpn[x]) {
-                const int box1 = (x >> d->xShift) * 4;
-                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
-                ++cArray[temp1 + box1];
-                ++cArray[temp1 + box2 + 1];
-                ++cArray[temp2 + box1 + 2];
-                ++cArray[temp2 + box2 + 3];
-            }
+#ifdef VS_TARGET_CPU_X86
+        if ((opt == 0 && iset >= 8) || opt == 3 || opt == 4) {
+            d->combRow = combRow_avx2<uint8_t, Vec32uc, Vec16s, 32>;
+            d->countBand = countBand_avx2<uint8_t, Vec32uc, 32>;
+            if (chromaWidth >= 32 + 2)
+                d->linkRow = (ssw == 0) ? linkRow_avx2<uint8_t, Vec32uc, Vec32c, 32, 0> :
+                                (ssw == 1) ? linkRow_avx2<uint8_t, Vec32uc, Vec32c, 32, 1> : linkRow_avx2<uint8_t, Vec32uc, Vec32c, 32, 2>;
+        } else if ((opt == 0 && iset >= 2) || opt == 2) {
+            d->combRow = combRow_sse2<uint8_t, Vec16uc, Vec8s, 16>;
+            d->countBand = countBand_sse2<uint8_t, Vec16uc, 16>;
+            if (chromaWidth >= 16 + 2)
+                d->linkRow = (ssw == 0) ? linkRow_sse2<uint8_t, Vec16uc, Vec16c, 16, 0> :
+                                (ssw == 1) ? linkRow_sse2<uint8_t, Vec16uc, Vec16c, 16, 1> : linkRow_sse2<uint8_t, Vec16uc, Vec16c, 16, 2>;
         }
+#endif
+    } else {
+        d->combRow = combRow<uint16_t>;
+        d->linkRow = linkRow<uint16_t>;
+        d->countBand = countBand<uint16_t>;
 
-        cmkpp += stride;
-        cmkp += stride;
-        cmkpn += stride;
+#ifdef VS_TARGET_CPU_X86
+        if ((opt == 0 && iset >= 8) || opt == 3 || opt == 4) {
+            d->combRow = combRow_avx2<uint16_t, Vec16us, Vec8i, 16>;
+            d->countBand = countBand_avx2<uint16_t, Vec16us, 16>;
+            if (chromaWidth >= 16 + 2)
+                d->linkRow = (ssw == 0) ? linkRow_avx2<uint16_t, Vec16us, Vec16s, 16, 0> :
+                                (ssw == 1) ? linkRow_avx2<uint16_t, Vec16us, Vec16s, 16, 1> : linkRow_avx2<uint16_t, Vec16us, Vec16s, 16, 2>;
+        } else if ((opt == 0 && iset >= 2) || opt == 2) {
+            d->combRow = combRow_sse2<uint16_t, Vec8us, Vec4i, 8>;
+            d->countBand = countBand_sse2<uint16_t, Vec8us, 8>;
+            if (chromaWidth >= 8 + 2)
+                d->linkRow = (ssw == 0) ? linkRow_sse2<uint16_t, Vec8us, Vec8s, 8, 0> :
+                                (ssw == 1) ? linkRow_sse2<uint16_t, Vec8us, Vec8s, 8, 1> : linkRow_sse2<uint16_t, Vec8us, Vec8s, 8, 2>;
+        }
+#endif
     }
+}
 
-    for (int y = d->yHalf; y < d->heighta; y += d->yHalf) {
-        const int temp1 = (y >> d->yShift) * d->xBlocks4;
-        const int temp2 = ((y + d->yHalf) >> d->yShift) * d->xBlocks4;
+// Checks the parameters of the comb test in d, which come from IsCombed or from TDeintMod with full=False, and sets up the rest
+static void initCombed(IsCombedData * d, const int opt, VSCore * core, const VSAPI * vsapi) {
+    if (!isConstantFormat(d->vi) || d->vi->format->sampleType != stInteger || d->vi->format->bitsPerSample > 16)
+        throw std::string{ "only constant format 8-16 bit integer input supported" };
 
-        for (int x = 0; x < d->widtha; x += d->xHalf) {
-            const T * cmkppT = cmkpp;
-            const T * cmkpT = cmkp;
-            const T * cmkpnT = cmkpn;
-            int sum = 0;
+    if (d->vi->height < 5)
+        throw std::string{ "height must be greater than or equal to 5" };
 
-            for (int u = 0; u < d->yHalf; u++) {
-                for (int v = 0; v < d->xHalf; v++) {
-                    if (cmkppT[x + v] && cmkpT[x + v] && cmkpnT[x + v])
-                        sum++;
-                }
-                cmkppT += stride;
-                cmkpT += stride;
-                cmkpnT += stride;
-            }
+    if (d->vi->format->subSamplingW > 2)
+        throw std::string{ "only horizontal chroma subsampling 1x-4x supported" };
 
-            if (sum) {
-                const int box1 = (x >> d->xShift) * 4;
-                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
-                cArray[temp1 + box1] += sum;
-                cArray[temp1 + box2 + 1] += sum;
-                cArray[temp2 + box1 + 2] += sum;
-                cArray[temp2 + box2 + 3] += sum;
-            }
-        }
+    if (d->vi->format->subSamplingH > 2)
+        throw std::string{ "only vertical chroma subsampling 1x-4x supported" };
 
-        for (int x = d->widtha; x < width; x++) {
-            const T * cmkppT = cmkpp;
-            const T * cmkpT = cmkp;
-            const T * cmkpnT = cmkpn;
-            int sum = 0;
-
-            for (int u = 0; u < d->yHalf; u++) {
-                if (cmkppT[x] && cmkpT[x] && cmkpnT[x])
-                    sum++;
-                cmkppT += stride;
-                cmkpT += stride;
-                cmkpnT += stride;
-            }
+    for (auto cthresh : d->cthresh) {
+        if (cthresh < 0 || cthresh > 255)
+            throw std::string{ "cthresh must be between 0 and 255 (inclusive)" };
+    }
 
-            if (sum) {
-                const int box1 = (x >> d->xShift) * 4;
-                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
-                cArray[temp1 + box1] += sum;
-                cArray[temp1 + box2 + 1] += sum;
-                cArray[temp2 + box1 + 2] += sum;
-                cArray[temp2 + box2 + 3] += sum;
-            }
-        }
+    if (!isPowerOf2(d->blockx) || d->blockx < 4 || d->blockx > 2048)
+        throw std::string{ "illegal blockx size" };
+
+    if (!isPowerOf2(d->blocky) || d->blocky < 4 || d->blocky > 2048)
+        throw std::string{ "illegal blocky size" };
+
+    if (d->chroma && d->vi->format->colorFamily == cmGray)
+        throw std::string{ "chroma can not be true for Gray color family" };
 
-        cmkpp += stride * d->yHalf;
-        cmkp += stride * d->yHalf;
-        cmkpn += stride * d->yHalf;
+    for (auto MI : d->MI) {
+        if (MI < 0)
+            throw std::string{ "mi must be greater than or equal to 0" };
     }
 
-    for (int y = d->heighta; y < height - 1; y++) {
-        const int temp1 = (y >> d->yShift) * d->xBlocks4;
-        const int temp2 = ((y + d->yHalf) >> d->yShift) * d->xBlocks4;
+    for (auto metric : d->metric) {
+        if (metric < 0 || metric > 1)
+            throw std::string{ "metric must be 0 or 1" };
+    }
 
-        for (int x = 0; x < width; x++) {
-            if (cmkpp[x] && cmkp[x] && cmkpn[x]) {
-                const int box1 = (x >> d->xShift) * 4;
-                const int box2 = ((x + d->xHalf) >> d->xShift) * 4;
-                ++cArray[temp1 + box1];
-                ++cArray[temp1 + box2 + 1];
-                ++cArray[temp2 + box1 + 2];
-                ++cArray[temp2 + box2 + 3];
+    // a comb mask for every cthresh and metric, the metric changing fastest
+    for (auto cthresh : d->cthresh) {
+        cthresh = cthresh * ((1 << d->vi->format->bitsPerSample) - 1) / 255;
+
+        for (auto metric : d->metric)
+            d->masks.push_back({ metric, cthresh, cthresh * 6, static_cast<int64_t>(cthresh) * cthresh });
+    }
+
+    d->maxMI = *std::max_element(d->MI.cbegin(), d->MI.cend());
+
+    d->xHalf = d->blockx / 2;
+    d->yHalf = d->blocky / 2;
+    d->xShift = static_cast<int>(std::log2(d->blockx));
+    d->yShift = static_cast<int>(std::log2(d->blocky));
+
+    const int xBlocks = ((d->vi->width + d->xHalf) >> d->xShift) + 1;
+    const int yBlocks = ((d->vi->height + d->yHalf) >> d->yShift) + 1;
+    d->arraySize = xBlocks * yBlocks * 4;
+    d->xBlocks4 = xBlocks * 4;
+
+    // the rings of mask rows hold a band with the row above and below it, and up to six more rows that linked chroma marks
+    d->ringRows = d->yHalf + 8;
+    d->pitch = (d->vi->width * d->vi->format->bytesPerSample + 63) & ~63;
+    if (d->chroma)
+        d->pitchUV = ((d->vi->width >> d->vi->format->subSamplingW) * d->vi->format->bytesPerSample + 63) & ~63;
+
+    selectFunctions(opt, d);
+
+    // one buffer for every thread that can be in getFrame at once
+    d->scratch = new BufferPool<IsCombedScratch>{ static_cast<size_t>(vsapi->getCoreInfo(core)->numThreads) };
+}
+
+static void freeCombed(IsCombedData * d) noexcept {
+    while (IsCombedScratch * scratch = d->scratch->acquire())
+        vs_aligned_free(scratch);
+    delete d->scratch;
+}
+
+// Sets MIC, the top left pixel of the block it is found in and with d->blocks the count of every block of the first mask as frame properties
+static void setCombedStats(VSMap * props, const IsCombedScratch * scratch, const IsCombedData * d, const VSAPI * vsapi) noexcept {
+    const int * cArray = scratch->cArray;
+
+    int worst = 0;
+    for (int i = 1; i < d->arraySize; i++) {
+        if (cArray[i] > cArray[worst])
+            worst = i;
+    }
+
+    // the second block of every four is moved half a block to the left, the third half a block up and the fourth both
+    const int x = ((worst % d->xBlocks4) >> 2 << d->xShift) - ((worst & 1) ? d->xHalf : 0);
+    const int y = (worst / d->xBlocks4 << d->yShift) - ((worst & 2) ? d->yHalf : 0);
+
+    vsapi->propSetInt(props, "_CombedMIC", cArray[worst], paReplace);
+    vsapi->propSetInt(props, "_CombedMICX", std::max(x, 0), paReplace);
+    vsapi->propSetInt(props, "_CombedMICY", std::max(y, 0), paReplace);
+
+    if (d->blocks) {
+        // a count only gets past 16 bits in blocks of more than 65535 pixels
+        for (int i = 0; i < d->arraySize; i++)
+            scratch->blocks[i] = std::min(cArray[i], 65535);
+
+        vsapi->propSetData(props, "_CombedBlocks", reinterpret_cast<const char *>(scratch->blocks), d->arraySize * sizeof(uint16_t), paReplace);
+        vsapi->propSetInt(props, "_CombedBlocksWidth", d->xBlocks4 / 4, paReplace);
+        vsapi->propSetInt(props, "_CombedBlocksHeight", d->arraySize / d->xBlocks4, paReplace);
+    }
+}
+
+// Whether src is combed with the first of every parameter, or -1 when there is no memory for the scratch. When mask is given the
+// comb mask of the first cthresh and metric is made in it. When props is given _Combed is set in it, along with _CombedSet when
+// there is more than one set of parameters, and the statistics of the blocks with d->stats or d->blocks.
+static int64_t isCombed(const VSFrameRef * src, VSFrameRef * mask, VSMap * props, const IsCombedData * d, const VSAPI * vsapi) noexcept {
+    IsCombedScratch * scratch = d->scratch->acquire();
+    if (!scratch) {
+        scratch = newScratch(d);
+        if (!scratch)
+            return -1;
+    }
+
+    const bool stop = !mask && !d->stats && !d->blocks;
+    if (d->vi->format->bytesPerSample == 1)
+        checkCombed<uint8_t>(src, mask, scratch, stop, d, vsapi);
+    else
+        checkCombed<uint16_t>(src, mask, scratch, stop, d, vsapi);
+
+    const int64_t combed = scratch->MIC[0] > d->MI[0];
+
+    if (props) {
+        vsapi->propSetInt(props, "_Combed", combed, paReplace);
+
+        // in the order of the arguments, the last one changing fastest
+        if (d->cthresh.size() * d->MI.size() * d->metric.size() > 1) {
+            int i = 0;
+            for (size_t c = 0; c < d->cthresh.size(); c++) {
+                for (auto MI : d->MI) {
+                    for (size_t m = 0; m < d->metric.size(); m++)
+                        vsapi->propSetInt(props, "_CombedSet", scratch->MIC[c * d->metric.size() + m] > MI, i++ ? paAppend : paReplace);
+                }
             }
         }
 
-        cmkpp += stride;
-        cmkp += stride;
-        cmkpn += stride;
+        if (d->stats || d->blocks)
+            setCombedStats(props, scratch, d, vsapi);
     }
 
-    int MIC = 0;
-    for (int x = 0; x < d->arraySize; x++) {
-        if (cArray[x] > MIC)
-            MIC = cArray[x];
-    }
-    return MIC > d->MI;
+    if (!d->scratch->release(scratch))
+        vs_aligned_free(scratch);
+    return combed;
 }
 
 static void VS_CC iscombedInit(VSMap *in, VSMap *out, void **instanceData, VSNode *node, VSCore *core, const VSAPI *vsapi) {
     IsCombedData * d = static_cast<IsCombedData *>(*instanceData);
-    vsapi->setVideoInfo(d->vi, 1, node);
+
+    VSVideoInfo vi = *d->vi;
+    if (d->cmask)
+        vi.format = d->maskFormat;
+    vsapi->setVideoInfo(&vi, 1, node);
 }
 
 static const VSFrameRef *VS_CC iscombedGetFrame(int n, int activationReason, void **instanceData, void **frameData, VSFrameContext *frameCtx, VSCore *core, const VSAPI *vsapi) {
@@ -2034,27 +2320,19 @@ static const VSFrameRef *VS_CC iscombedGetFrame(int n, int activationReason, voi
     if (activationReason == arInitial) {
         vsapi->requestFrameFilter(n, d->node, frameCtx);
     } else if (activationReason == arAllFramesReady) {
-        auto threadId = std::this_thread::get_id();
-        if (!d->cArray.count(threadId)) {
-            int * cArray = new (std::nothrow) int[d->arraySize];
-            if (!cArray) {
-                vsapi->setFilterError("IsCombed: malloc failure (cArray)", frameCtx);
-                return nullptr;
-            }
-            d->cArray.emplace(threadId, cArray);
-        }
-
         const VSFrameRef * src = vsapi->getFrameFilter(n, d->node, frameCtx);
-        VSFrameRef * cmask = vsapi->newVideoFrame(d->vi->format, d->vi->width, d->vi->height, nullptr, core);
-        VSFrameRef * dst = vsapi->copyFrame(src, core);
 
-        if (d->vi->format->bytesPerSample == 1)
-            vsapi->propSetInt(vsapi->getFramePropsRW(dst), "_Combed", checkCombed<uint8_t>(src, cmask, d, vsapi), paReplace);
-        else
-            vsapi->propSetInt(vsapi->getFramePropsRW(dst), "_Combed", checkCombed<uint16_t>(src, cmask, d, vsapi), paReplace);
+        VSFrameRef * dst = d->cmask ? vsapi->newVideoFrame(d->maskFormat, d->vi->width, d->vi->height, src, core) : vsapi->copyFrame(src, core);
+        VSMap * props = vsapi->getFramePropsRW(dst);
+
+        if (isCombed(src, d->cmask ? dst : nullptr, props, d, vsapi) < 0) {
+            vsapi->setFilterError("IsCombed: malloc failure (scratch)", frameCtx);
+            vsapi->freeFrame(src);
+            vsapi->freeFrame(dst);
+            return nullptr;
+        }
 
         vsapi->freeFrame(src);
-        vsapi->freeFrame(cmask);
         return dst;
     }
 
@@ -2065,10 +2343,7 @@ static void VS_CC iscombedFree(void *instanceData, VSCore *core, const VSAPI *vs
     IsCombedData * d = static_cast<IsCombedData *>(instanceData);
 
     vsapi->freeNode(d->node);
-
-    for (auto & iter : d->cArray)
-        delete[] iter.second;
-
+    freeCombed(d);
     delete d;
 }
 
@@ -2079,22 +2354,18 @@ static void VS_CC iscombedCreate(const VSMap *in, VSMap *out, void *userData, VS
     d->node = vsapi->propGetNode(in, "clip", 0, nullptr);
     d->vi = vsapi->getVideoInfo(d->node);
 
-    try {
-        if (!isConstantFormat(d->vi) || d->vi->format->sampleType != stInteger || d->vi->format->bitsPerSample > 16)
-            throw std::string{ "only constant format 8-16 bit integer input supported" };
-
-        if (d->vi->height < 5)
-            throw std::string{ "height must be greater than or equal to 5" };
-
-        if (d->vi->format->subSamplingW > 2)
-            throw std::string{ "only horizontal chroma subsampling 1x-4x supported" };
+    // every element of cthresh, mi and metric is combined with every element of the others
+    const auto getInts = [&](const char * name, const int def) {
+        std::vector<int> values;
+        for (int i = 0; i < vsapi->propNumElements(in, name); i++)
+            values.push_back(int64ToIntS(vsapi->propGetInt(in, name, i, nullptr)));
+        if (values.empty())
+            values.push_back(def);
+        return values;
+    };
 
-        if (d->vi->format->subSamplingH > 2)
-            throw std::string{ "only vertical chroma subsampling 1x-4x supported" };
-
-        d->cthresh = int64ToIntS(vsapi->propGetInt(in, "cthresh", 0, &err));
-        if (err)
-            d->cthresh = 6;
+    try {
+        d->cthresh = getInts("cthresh", 6);
 
         d->blockx = int64ToIntS(vsapi->propGetInt(in, "blockx", 0, &err));
         if (err)
@@ -2106,50 +2377,24 @@ static void VS_CC iscombedCreate(const VSMap *in, VSMap *out, void *userData, VS
 
         d->chroma = !!vsapi->propGetInt(in, "chroma", 0, &err);
 
-        d->MI = int64ToIntS(vsapi->propGetInt(in, "mi", 0, &err));
-        if (err)
-            d->MI = 64;
-
-        d->metric = int64ToIntS(vsapi->propGetInt(in, "metric", 0, &err));
-
-        if (d->cthresh < 0 || d->cthresh > 255)
-            throw std::string{ "cthresh must be between 0 and 255 (inclusive)" };
+        d->MI = getInts("mi", 64);
 
-        if (!isPowerOf2(d->blockx) || d->blockx < 4 || d->blockx > 2048)
-            throw std::string{ "illegal blockx size" };
+        d->metric = getInts("metric", 0);
 
-        if (!isPowerOf2(d->blocky) || d->blocky < 4 || d->blocky > 2048)
-            throw std::string{ "illegal blocky size" };
-
-        if (d->chroma && d->vi->format->colorFamily == cmGray)
-            throw std::string{ "chroma can not be true for Gray color family" };
-
-        if (d->MI < 0)
-            throw std::string{ "mi must be greater than or equal to 0" };
+        const int opt = int64ToIntS(vsapi->propGetInt(in, "opt", 0, &err));
 
-        if (d->metric < 0 || d->metric > 1)
-            throw std::string{ "metric must be 0 or 1" };
+        d->stats = !!vsapi->propGetInt(in, "stats", 0, &err);
 
-        d->cArray.reserve(vsapi->getCoreInfo(core)->numThreads);
+        d->blocks = !!vsapi->propGetInt(in, "blocks", 0, &err);
 
-        d->cthresh = d->cthresh * ((1 << d->vi->format->bitsPerSample) - 1) / 255;
-        d->cthresh6 = d->cthresh * 6;
-        d->cthreshsq = d->cthresh * d->cthresh;
+        d->cmask = !!vsapi->propGetInt(in, "cmask", 0, &err);
 
-        d->xHalf = d->blockx / 2;
-        d->yHalf = d->blocky / 2;
-        d->xShift = static_cast<int>(std::log2(d->blockx));
-        d->yShift = static_cast<int>(std::log2(d->blocky));
+        if (opt < 0 || opt > 4)
+            throw std::string{ "opt must be 0, 1, 2, 3 or 4" };
 
-        const int xBlocks = ((d->vi->width + d->xHalf) >> d->xShift) + 1;
-        const int yBlocks = ((d->vi->height + d->yHalf) >> d->yShift) + 1;
-        d->arraySize = xBlocks * yBlocks * 4;
-        d->xBlocks4 = xBlocks * 4;
+        initCombed(d.get(), opt, core, vsapi);
 
-        d->widtha = (d->vi->width >> (d->xShift - 1)) << (d->xShift - 1);
-        d->heighta = (d->vi->height >> (d->yShift - 1)) << (d->yShift - 1);
-        if (d->heighta == d->vi->height)
-            d->heighta = d->vi->height - d->yHalf;
+        d->maskFormat = vsapi->registerFormat(cmGray, stInteger, d->vi->format->bytesPerSample * 8, 0, 0, core);
     } catch (const std::string & error) {
         vsapi->setError(out, ("IsCombed: " + error).c_str());
         vsapi->freeNode(d->node);
@@ -2187,15 +2432,27 @@ VS_EXTERNAL_API(void) VapourSynthPluginInit(VSConfigPlugin configFunc, VSRegiste
                  "show:int:opt;"
                  "edeint:clip:opt;"
                  "opt:int:opt;"
-                 "planes:int[]:opt;",
+                 "planes:int[]:opt;"
+                 "cache_mb:int:opt;"
+                 "threads:int:opt;"
+                 "full:int:opt;"
+                 "cthresh:int:opt;"
+                 "blockx:int:opt;"
+                 "blocky:int:opt;"
+                 "chroma:int:opt;"
+                 "mi:int:opt;",
                  tdeintmodCreate, nullptr, plugin);
     registerFunc("IsCombed",
                  "clip:clip;"
-                 "cthresh:int:opt;"
+                 "cthresh:int[]:opt;"
                  "blockx:int:opt;"
                  "blocky:int:opt;"
                  "chroma:int:opt;"
-                 "mi:int:opt;"
-                 "metric:int:opt;",
+                 "mi:int[]:opt;"
+                 "metric:int[]:opt;"
+                 "opt:int:opt;"
+                 "stats:int:opt;"
+                 "blocks:int:opt;"
+                 "cmask:int:opt;",
                  iscombedCreate, nullptr, plugin);
 }
@@ -2,37 +2,406 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 #include <VapourSynth.h>
 #include <VSHelper.h>
 
-#if defined(VS_TARGET_CPU_X86) || defined(__ARM_NEON__)
+#ifdef VS_TARGET_CPU_X86
 #include "vectorclass/vectorclass.h"
+
+// only TDeintMod_AVX512.cpp is built with 512-bit vectors, the rest just names its kernels
+#if MAX_VECTOR_SIZE < 512
+class Vec64uc;
+class Vec32us;
+#endif
 #endif
 
+// Small cache of intermediate TMM frames, keyed by field number. get() and put() both work on new references,
+// so the caller always frees what it holds and an evicted entry stays alive while some frame still uses it.
+// Every output frame in flight pins the key range its sliding window reads. Eviction takes the least recently used
+// entry outside all pinned windows, and only falls back to a pinned one when nothing else is left.
+class TMMCache {
+    struct Entry {
+        int key;
+        uint64_t lastUse;
+        std::vector<const VSFrameRef *> frames;
+    };
+
+    const size_t maxEntries, framesPerEntry;
+    uint64_t useCount = 0;
+    std::vector<Entry> entries;
+    std::vector<std::pair<int, int>> windows;
+    std::mutex mutex;
+
+    bool pinned(const int key) const noexcept {
+        return std::any_of(windows.begin(), windows.end(), [key](const std::pair<int, int> & w) { return key >= w.first && key <= w.second; });
+    }
+
+public:
+    TMMCache(const size_t capacity, const size_t size) : maxEntries(capacity), framesPerEntry(size) {
+        entries.reserve(maxEntries);
+    }
+
+    bool get(const int key, const VSFrameRef ** frames, const VSAPI * vsapi) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        for (auto & entry : entries) {
+            if (entry.key == key) {
+                entry.lastUse = ++useCount;
+                for (size_t i = 0; i < framesPerEntry; i++)
+                    frames[i] = entry.frames[i] ? vsapi->cloneFrameRef(entry.frames[i]) : nullptr;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void put(const int key, const VSFrameRef * const * frames, const VSAPI * vsapi) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        for (auto & entry : entries) {
+            if (entry.key == key) // another thread got there first
+                return;
+        }
+
+        Entry entry{ key, ++useCount, std::vector<const VSFrameRef *>(framesPerEntry) };
+        for (size_t i = 0; i < framesPerEntry; i++)
+            entry.frames[i] = frames[i] ? vsapi->cloneFrameRef(frames[i]) : nullptr;
+
+        if (entries.size() < maxEntries) {
+            entries.push_back(std::move(entry));
+        } else {
+            auto victim = entries.end();
+            for (auto iter = entries.begin(); iter != entries.end(); ++iter) {
+                if (!pinned(iter->key) && (victim == entries.end() || iter->lastUse < victim->lastUse))
+                    victim = iter;
+            }
+            if (victim == entries.end())
+                victim = std::min_element(entries.begin(), entries.end(), [](const Entry & a, const Entry & b) { return a.lastUse < b.lastUse; });
+
+            for (auto frame : victim->frames)
+                vsapi->freeFrame(frame);
+            *victim = std::move(entry);
+        }
+    }
+
+    // Keeps a window pinned until it is destroyed
+    class Pin {
+        TMMCache * cache;
+        std::pair<int, int> window;
+
+    public:
+        Pin(TMMCache * owner, const std::pair<int, int> & range) noexcept : cache(owner), window(range) {}
+
+        Pin(Pin && other) noexcept : cache(other.cache), window(other.window) {
+            other.cache = nullptr;
+        }
+
+        Pin(const Pin &) = delete;
+        Pin & operator=(const Pin &) = delete;
+
+        ~Pin() {
+            if (cache)
+                cache->unpin(window);
+        }
+    };
+
+    Pin pin(const int first, const int last) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        windows.emplace_back(first, last);
+        return Pin{ this, windows.back() };
+    }
+
+    // only safe once no frame is in flight, so it does not take the lock
+    void clear(const VSAPI * vsapi) {
+        for (auto & entry : entries) {
+            for (auto frame : entry.frames)
+                vsapi->freeFrame(frame);
+        }
+        entries.clear();
+    }
+
+private:
+    void unpin(const std::pair<int, int> & window) {
+        std::lock_guard<std::mutex> lock{ mutex };
+        const auto iter = std::find(windows.begin(), windows.end(), window);
+        if (iter != windows.end())
+            windows.erase(iter);
+    }
+};
+
+// Lock-free pool of buffers that a call keeps only while it runs. acquire() takes any buffer from the slots and gives nullptr when
+// they are all empty, so the caller makes a new one. release() puts a buffer back into an empty slot and returns false when every
+// slot is full, so the caller frees it. No more buffers than slots outlive the calls that used them.
+template<typename T>
+class BufferPool {
+    const size_t size;
+    std::unique_ptr<std::atomic<T *>[]> slots;
+
+public:
+    explicit BufferPool(const size_t count) : size(count), slots(new std::atomic<T *>[count]) {
+        for (size_t i = 0; i < size; i++)
+            slots[i] = nullptr;
+    }
+
+    T * acquire() noexcept {
+        for (size_t i = 0; i < size; i++) {
+            if (T * buffer = slots[i].exchange(nullptr))
+                return buffer;
+        }
+        return nullptr;
+    }
+
+    bool release(T * buffer) noexcept {
+        for (size_t i = 0; i < size; i++) {
+            T * empty = nullptr;
+            if (slots[i].compare_exchange_strong(empty, buffer))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Bump allocator for temporaries that never leave a getFrame call. Every Scope takes a set of chunks from a lock-free pool and
+// hands it back when it ends, so once warmed up a frame request neither locks nor touches the heap. Allocations live until the
+// Scope they came from is destroyed. Nested scopes simply take another set. Sets that find the pool full are freed.
+class ScratchArena {
+    struct Chunk {
+        uint8_t * data;
+        size_t size;
+    };
+
+    struct Local {
+        std::vector<Chunk> chunks;
+        size_t chunk = 0, offset = 0;
+
+        ~Local() {
+            for (const auto & c : chunks)
+                vs_aligned_free(c.data);
+        }
+    };
+
+    BufferPool<Local> locals;
+
+public:
+    class Scope {
+        BufferPool<Local> & pool;
+        Local * local;
+
+    public:
+        explicit Scope(BufferPool<Local> & owner) : pool(owner), local(owner.acquire()) {
+            if (!local)
+                local = new Local;
+        }
+
+        Scope(Scope && other) noexcept : pool(other.pool), local(other.local) {
+            other.local = nullptr;
+        }
+
+        Scope(const Scope &) = delete;
+        Scope & operator=(const Scope &) = delete;
+
+        ~Scope() {
+            if (!local)
+                return;
+
+            local->chunk = 0;
+            local->offset = 0;
+            if (!pool.release(local))
+                delete local;
+        }
+
+        template<typename T>
+        T * alloc(const size_t count) {
+            const size_t bytes = (sizeof(T) * count + 63) & ~static_cast<size_t>(63);
+
+            while (local->chunk < local->chunks.size() && local->offset + bytes > local->chunks[local->chunk].size) {
+                local->chunk++;
+                local->offset = 0;
+            }
+
+            if (local->chunk == local->chunks.size()) {
+                const size_t size = std::max<size_t>(bytes, 65536);
+                local->chunks.push_back({ vs_aligned_malloc<uint8_t>(size, 64), size });
+                local->offset = 0;
+            }
+
+            T * ptr = reinterpret_cast<T *>(local->chunks[local->chunk].data + local->offset);
+            local->offset += bytes;
+            return ptr;
+        }
+    };
+
+    // count is the most scopes expected to be open at once
+    explicit ScratchArena(const size_t count) : locals(count) {}
+
+    ~ScratchArena() {
+        while (Local * local = locals.acquire())
+            delete local;
+    }
+
+    Scope scope() {
+        return Scope{ locals };
+    }
+};
+
+// Helper threads that split the work of a single frame into strips. run() queues a job of `count` tasks and takes part in it
+// from the calling thread. Idle helpers pick up the next task of whichever job is at the head of the queue, so several frames
+// in flight share the pool. run() returns once every task of its own job has finished.
+class StripPool {
+    struct Job {
+        const std::function<void(int)> * task;
+        int count, next, done;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<Job *> queue;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    bool stop = false;
+
+    // called and returns with the lock held
+    void work(Job & job, std::unique_lock<std::mutex> & lock) {
+        while (job.next < job.count) {
+            const int i = job.next++;
+            if (job.next == job.count)
+                queue.erase(std::find(queue.begin(), queue.end(), &job));
+
+            lock.unlock();
+            (*job.task)(i);
+            lock.lock();
+
+            if (++job.done == job.count) {
+                finished.notify_all();
+                return;
+            }
+        }
+    }
+
+public:
+    explicit StripPool(const int threads) {
+        for (int i = 0; i < threads - 1; i++) {
+            workers.emplace_back([this] {
+                std::unique_lock<std::mutex> lock{ mutex };
+                while (true) {
+                    wake.wait(lock, [this] { return stop || !queue.empty(); });
+                    if (stop)
+                        return;
+                    work(*queue.front(), lock);
+                }
+            });
+        }
+    }
+
+    ~StripPool() {
+        {
+            std::lock_guard<std::mutex> lock{ mutex };
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto & worker : workers)
+            worker.join();
+    }
+
+    void run(const int count, const std::function<void(int)> & task) {
+        Job job{ &task, count, 0, 0 };
+        std::unique_lock<std::mutex> lock{ mutex };
+        queue.push_back(&job);
+        wake.notify_all();
+        work(job, lock);
+        finished.wait(lock, [&job] { return job.done == job.count; });
+    }
+};
+
+struct IsCombedData;
+
 struct TDeintModData {
-    VSNodeRef * node, * node2, * propNode, * mask, * edeint;
+    VSNodeRef * node, * edeint;
+    const VSFrameRef * zeroField;
+    TMMCache * fieldCache, * pairCache, * mmCache;
+    IsCombedData * combed;
+    std::atomic<int64_t> * lastCombed;
+    ScratchArena * scratch;
+    StripPool * pool;
     VSVideoInfo vi;
     const VSVideoInfo * viSaved;
     int order, field, mode, length, mtype, ttype, mtqL, mthL, mtqC, mthC, nt, minthresh, maxthresh, cstr, athresh, metric, expand;
-    bool link, show, process[3];
-    int hShift[3], vShift[3], hHalf[3], vHalf[3], athresh6, athreshsq, widthPad, peak;
+    bool link, show, tmm, process[3];
+    int hShift[3], vShift[3], hHalf[3], vHalf[3], athresh6, widthPad, bitWidth, peak, strips;
+    int64_t athreshsq;
     uint8_t * gvlut;
     std::array<uint8_t, 64> vlut;
     std::array<uint8_t, 16> tmmlut16;
-    const VSFormat * format;
-    void (*copyPad)(const VSFrameRef *, VSFrameRef *, const int, const int, const VSAPI *);
-    void (*threshMask)(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*motionMask)(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*andMasks)(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*combineMasks)(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*buildMask)(VSFrameRef **, VSFrameRef **, VSFrameRef *, const int, const int, const int, const int, const TDeintModData *, const VSAPI *);
-    void (*setMaskForUpsize)(VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*checkSpatial)(const VSFrameRef *, VSFrameRef *, const TDeintModData *, const VSAPI *);
-    void (*expandMask)(VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*linkMask)(VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
-    void (*eDeint)(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const TDeintModData *, const VSAPI *);
-    void (*cubicDeint)(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const TDeintModData *, const VSAPI *);
-    void (*binaryMask)(const VSFrameRef *, VSFrameRef *, const TDeintModData *, const VSAPI *);
+    const VSFormat * format, * bitFormat, * maskFormat;
+    void (*copyPad)(const VSFrameRef *, VSFrameRef *, const int, const int, const int, const VSAPI *);
+    void (*threshMask)(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *);
+    void (*packMotion)(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *);
+    void (*buildMask)(const VSFrameRef **, const VSFrameRef **, VSFrameRef *, const int, const int, const int, const int, const int, const TDeintModData *, const VSAPI *);
+    void (*setMaskForUpsize)(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *);
+    void (*checkSpatial)(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
+    void (*expandMask)(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *);
+    void (*linkMask)(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *);
+    void (*eDeint)(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
+    void (*cubicDeint)(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
+    void (*binaryMask)(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *);
+};
+
+// Per-thread buffers of IsCombed, all carved from one allocation
+struct IsCombedScratch {
+    int * cArray, * MIC;
+    uint16_t * columns, * blocks;
+    const uint8_t ** bandRows;
+    uint8_t ** maskRows;
+    uint8_t * ring[3];
 };
+
+// Thresholds of one of the comb masks that IsCombed makes in the same pass
+struct CombMask {
+    int metric, cthresh, cthresh6;
+    int64_t cthreshsq;
+};
+
+struct IsCombedData {
+    VSNodeRef * node;
+    const VSVideoInfo * vi;
+    std::vector<int> cthresh, MI, metric;
+    int blockx, blocky;
+    bool chroma, stats, blocks, cmask;
+    std::vector<CombMask> masks;
+    int maxMI, xHalf, yHalf, xShift, yShift, arraySize, xBlocks4, ringRows, pitch, pitchUV;
+    const VSFormat * maskFormat;
+    BufferPool<IsCombedScratch> * scratch;
+    void (*combRow)(const uint8_t *, const int, const int, const int, const int, uint8_t * const *, const IsCombedData *);
+    void (*linkRow)(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *);
+    void (*countBand)(const uint8_t * const *, const int, const int, uint16_t *);
+};
+
+// Rows [first, second) of strip `strip` when `rows` rows are split evenly into d->strips
+static inline std::pair<int, int> stripRows(const int rows, const int strip, const TDeintModData * d) noexcept {
+    return { rows * strip / d->strips, rows * (strip + 1) / d->strips };
+}
+
+// Luma rows that a combed chroma pixel of row y marks in IsCombed, returns how many there are
+static inline int chromaRows(const int y, const int ssh, int * rows) noexcept {
+    const int top = y << ssh;
+    rows[0] = top;
+    if (ssh == 0)
+        return 1;
+
+    rows[1] = top + 1;
+    rows[2] = (y & 1) ? top - 1 : top + 2;
+    if (ssh == 1)
+        return 3;
+
+    rows[3] = top - 2;
+    rows[4] = (y & 1) ? top - 3 : top - 1;
+    return 5;
+}
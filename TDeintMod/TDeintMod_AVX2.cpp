@@ -10,31 +10,71 @@ static inline T abs_dif(const T & a, const T & b) noexcept {
     return sub_saturated(a, b) | sub_saturated(b, a);
 }
 
+// checkSpatial does its arithmetic on signed lanes twice as wide as the pixels, one half of the vector at a time
+static inline Vec16s widen_low(const Vec32uc & a) noexcept { return Vec16s(extend_low(a)); }
+static inline Vec16s widen_high(const Vec32uc & a) noexcept { return Vec16s(extend_high(a)); }
+static inline Vec8i widen_low(const Vec16us & a) noexcept { return Vec8i(extend_low(a)); }
+static inline Vec8i widen_high(const Vec16us & a) noexcept { return Vec8i(extend_high(a)); }
+
+// |a| * |b| > t for lanes that are at most peak, which can not overflow the unsigned lane
+static inline Vec16sb product_gt(const Vec16s & a, const Vec16s & b, const int64_t t) noexcept {
+    return Vec16us(abs(a)) * Vec16us(abs(b)) > Vec16us(static_cast<uint16_t>(t));
+}
+
+static inline Vec8ib product_gt(const Vec8i & a, const Vec8i & b, const int64_t t) noexcept {
+    return Vec8ui(abs(a)) * Vec8ui(abs(b)) > Vec8ui(static_cast<uint32_t>(std::min<int64_t>(t, UINT32_MAX)));
+}
+
+// one mask byte per pixel of a vector, all bits set where the lane of the halves is true
+static inline Vec32uc narrow_bool(const Vec16s & low, const Vec16s & high) noexcept { return Vec32uc(compress(low, high)); }
+static inline Vec16uc narrow_bool(const Vec8i & low, const Vec8i & high) noexcept {
+    const Vec16s words = compress(low, high);
+    return Vec16uc(compress(words.get_low(), words.get_high()));
+}
+
+static inline Vec32uc load_mask(const uint8_t * p, const Vec32uc &) noexcept { return Vec32uc().load_a(p); }
+static inline Vec16uc load_mask(const uint8_t * p, const Vec16us &) noexcept { return Vec16uc().load_a(p); }
+static inline void store_mask(uint8_t * p, const Vec32uc & a, const Vec32uc &) noexcept { a.store_a(p); }
+static inline void store_mask(uint8_t * p, const Vec16uc & a, const Vec16us &) noexcept { a.store_a(p); }
+
+// eDeint and cubicDeint compare the mask codes in lanes as wide as the pixels
+static inline Vec32uc mask_codes(const uint8_t * p, const Vec32uc &) noexcept { return Vec32uc().load_a(p); }
+static inline Vec16us mask_codes(const uint8_t * p, const Vec16us &) noexcept { return extend(Vec16uc().load_a(p)); }
+
+static inline Vec32uc narrow(const Vec16s & low, const Vec16s & high) noexcept { return Vec32uc(compress(low, high)); }
+static inline Vec16us narrow(const Vec8i & low, const Vec8i & high) noexcept { return Vec16us(compress(low, high)); }
+
 template<typename T1, typename T2, int step>
-void threshMask_avx2(const VSFrameRef * src, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+void threshMask_avx2(const VSFrameRef * src, VSFrameRef * dst, const int plane, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     constexpr T1 peak = std::numeric_limits<T1>::max();
 
     const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = d->vi.height >> (plane ? d->vi.format->subSamplingH : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
     const int stride = vsapi->getStride(src, 0) / sizeof(T1);
     const T1 * srcp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
     T1 * dstp0 = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
     T1 * dstp1 = dstp0 + stride * height;
 
+    const auto rows = stripRows(height, strip, d);
+
     if (plane == 0 && d->mtqL > -1 && d->mthL > -1) {
-        std::fill_n(dstp0 - d->widthPad, stride * height, static_cast<T1>(d->mtqL));
-        std::fill_n(dstp1 - d->widthPad, stride * height, static_cast<T1>(d->mthL));
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mtqL));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mthL));
         return;
     } else if (plane > 0 && d->mtqC > -1 && d->mthC > -1) {
-        std::fill_n(dstp0 - d->widthPad, stride * height, static_cast<T1>(d->mtqC));
-        std::fill_n(dstp1 - d->widthPad, stride * height, static_cast<T1>(d->mthC));
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mtqC));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mthC));
         return;
     }
 
-    const T1 * srcpp = srcp + stride;
-    const T1 * srcpn = srcpp;
+    // the rows above and below the strip are read in place, mirrored at the plane edges
+    srcp += stride * rows.first;
+    dstp0 += stride * rows.first;
+    dstp1 += stride * rows.first;
+    const T1 * srcpp = rows.first ? srcp - stride : srcp + stride;
+    const T1 * srcpn = (rows.first > 0 && rows.first == height - 1) ? srcp - stride : srcp + stride;
 
-    for (int y = 0; y < height; y++) {
+    for (int y = rows.first; y < rows.second; y++) {
         for (int x = 0; x < width; x += step) {
             const T2 topLeft = T2().load(srcpp + x - 1);
             const T2 top = T2().load_a(srcpp + x);
@@ -169,119 +209,469 @@ void threshMask_avx2(const VSFrameRef * src, VSFrameRef * dst, const int plane,
         dstp1 += stride;
     }
 
-    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0));
+    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + stride * rows.first;
     if (plane == 0 && d->mtqL > -1)
-        std::fill_n(dstp, stride * height, static_cast<T1>(d->mtqL));
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T1>(d->mtqL));
     else if (plane == 0 && d->mthL > -1)
-        std::fill_n(dstp + stride * height, stride * height, static_cast<T1>(d->mthL));
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T1>(d->mthL));
     else if (plane > 0 && d->mtqC > -1)
-        std::fill_n(dstp, stride * height, static_cast<T1>(d->mtqC));
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T1>(d->mtqC));
     else if (plane > 0 && d->mthC > -1)
-        std::fill_n(dstp + stride * height, stride * height, static_cast<T1>(d->mthC));
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T1>(d->mthC));
 }
 
-template void threshMask_avx2<uint8_t, Vec32uc, 32>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void threshMask_avx2<uint16_t, Vec16us, 16>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void threshMask_avx2<uint8_t, Vec32uc, 32>(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void threshMask_avx2<uint16_t, Vec16us, 16>(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
 
 template<typename T1, typename T2, int step>
-void motionMask_avx2(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, VSFrameRef * dst,
-                     const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+void packMotion_avx2(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, uint64_t * dstpq, uint64_t * dstph,
+                     const int y, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
     const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = d->vi.height >> (plane ? d->vi.format->subSamplingH : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
     const int stride = vsapi->getStride(src1, 0) / sizeof(T1);
-    const T1 * srcp1 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src1, 0)) + d->widthPad;
-    const T1 * srcp2 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src2, 0)) + d->widthPad;
-    const T1 * mskp1q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad;
-    const T1 * mskp2q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad;
-    T1 * dstpq = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
-
+    const T1 * srcp1 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src1, 0)) + d->widthPad + stride * y;
+    const T1 * srcp2 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src2, 0)) + d->widthPad + stride * y;
+    const T1 * mskp1q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad + stride * y;
+    const T1 * mskp2q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad + stride * y;
     const T1 * mskp1h = mskp1q + stride * height;
     const T1 * mskp2h = mskp2q + stride * height;
-    T1 * dstph = dstpq + stride * height;
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x += step) {
-            const T2 diff = abs_dif<T2>(T2().load_a(srcp1 + x), T2().load_a(srcp2 + x));
-            const T2 minq = min(T2().load_a(mskp1q + x), T2().load_a(mskp2q + x));
-            const T2 minh = min(T2().load_a(mskp1h + x), T2().load_a(mskp2h + x));
-            const T2 threshq = min(max(add_saturated(minq, d->nt), d->minthresh), d->maxthresh);
-            const T2 threshh = min(max(add_saturated(minh, d->nt), d->minthresh), d->maxthresh);
-            select(diff <= threshq, T2(1), zero_256b()).stream(dstpq + x);
-            select(diff <= threshh, T2(1), zero_256b()).stream(dstph + x);
+    uint64_t bitsq = 0, bitsh = 0;
+
+    for (int x = 0; x < width; x += step) {
+        const T2 diff = abs_dif<T2>(T2().load_a(srcp1 + x), T2().load_a(srcp2 + x));
+        const T2 minq = min(T2().load_a(mskp1q + x), T2().load_a(mskp2q + x));
+        const T2 minh = min(T2().load_a(mskp1h + x), T2().load_a(mskp2h + x));
+        const T2 threshq = min(max(add_saturated(minq, d->nt), d->minthresh), d->maxthresh);
+        const T2 threshh = min(max(add_saturated(minh, d->nt), d->minthresh), d->maxthresh);
+        bitsq |= static_cast<uint64_t>(to_bits(diff <= threshq)) << (x & 63);
+        bitsh |= static_cast<uint64_t>(to_bits(diff <= threshh)) << (x & 63);
+
+        if (((x + step) & 63) == 0 || x + step >= width) {
+            dstpq[x >> 6] = bitsq;
+            dstph[x >> 6] = bitsh;
+            bitsq = bitsh = 0;
         }
+    }
 
-        srcp1 += stride;
-        srcp2 += stride;
-        mskp1q += stride;
-        mskp1h += stride;
-        mskp2q += stride;
-        mskp2h += stride;
-        dstpq += stride;
-        dstph += stride;
+    if (width & 63) {
+        const uint64_t valid = (static_cast<uint64_t>(1) << (width & 63)) - 1;
+        dstpq[width >> 6] &= valid;
+        dstph[width >> 6] &= valid;
     }
 }
 
-template void motionMask_avx2<uint8_t, Vec32uc, 32>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void motionMask_avx2<uint16_t, Vec16us, 16>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void packMotion_avx2<uint8_t, Vec32uc, 32>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void packMotion_avx2<uint16_t, Vec16us, 16>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+// the comb test shared by checkSpatial and IsCombed
+template<typename T3>
+static inline T3 spatial_combed(const T3 & ppp, const T3 & pp, const T3 & c, const T3 & pn, const T3 & pnn,
+                                const int metric, const int thresh, const int thresh6, const int64_t threshsq) noexcept {
+    const T3 first = c - pp;
+    const T3 second = c - pn;
+    if (metric == 0) {
+        return (((first > T3(thresh)) & (second > T3(thresh))) | ((first < T3(-thresh)) & (second < T3(-thresh)))) &
+               (abs(ppp + c * 4 + pnn - (pp + pn) * 3) > T3(thresh6));
+    }
+    // lanes of opposite sign are rejected here, a zero lane already fails the product test
+    return ((first ^ second) >= T3(0)) & product_gt(first, second, threshsq);
+}
 
-template<typename T1, typename T2, int step>
-void andMasks_avx2(const VSFrameRef * src1, const VSFrameRef * src2, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
-    const int height = (d->vi.height * 2) >> (plane ? d->vi.format->subSamplingH : 0);
-    const int stride = vsapi->getStride(src1, 0) / sizeof(T1);
-    const T1 * srcp1 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src1, 0)) + d->widthPad;
-    const T1 * srcp2 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src2, 0)) + d->widthPad;
-    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
+template<typename T1, typename T2, typename T3, int step>
+void checkSpatial_avx2(const VSFrameRef * src, VSFrameRef * dst, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    using M = decltype(narrow_bool(T3(), T3()));
+
+    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = vsapi->getFrameWidth(src, plane);
+            const int height = vsapi->getFrameHeight(src, plane);
+            const int stride = vsapi->getStride(src, plane) / sizeof(T1);
+            const int dstStride = vsapi->getStride(dst, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T1 * srcp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            uint8_t * VS_RESTRICT dstp = vsapi->getWritePtr(dst, plane) + dstStride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
+                // rows past the top and bottom are mirrored
+                const T1 * srcppp = srcp + stride * (y > 1 ? -2 : 2);
+                const T1 * srcpp = srcp + stride * (y > 0 ? -1 : 1);
+                const T1 * srcpn = srcp + stride * (y < height - 1 ? 1 : -1);
+                const T1 * srcpnn = srcp + stride * (y < height - 2 ? 2 : -2);
+
+                for (int x = 0; x < width; x += step) {
+                    const T2 ppp = T2().load_a(srcppp + x);
+                    const T2 pp = T2().load_a(srcpp + x);
+                    const T2 c = T2().load_a(srcp + x);
+                    const T2 pn = T2().load_a(srcpn + x);
+                    const T2 pnn = T2().load_a(srcpnn + x);
+                    const T3 low = spatial_combed(widen_low(ppp), widen_low(pp), widen_low(c), widen_low(pn), widen_low(pnn),
+                                                  d->metric, d->athresh, d->athresh6, d->athreshsq);
+                    const T3 high = spatial_combed(widen_high(ppp), widen_high(pp), widen_high(c), widen_high(pn), widen_high(pnn),
+                                                   d->metric, d->athresh, d->athresh6, d->athreshsq);
+
+                    // 60 turns into 10 wherever the test fails
+                    const M mask = load_mask(dstp + x, T2());
+                    const M reset = M(mask == 60) & ~narrow_bool(low, high);
+                    store_mask(dstp + x, M(mask ^ ((mask ^ 10) & reset)), T2());
+                }
+
+                srcp += stride;
+                dstp += dstStride;
+            }
+        }
+    }
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x += step)
-            (T2().load_a(srcp1 + x) & T2().load_a(srcp2 + x) & T2().load_a(dstp + x)).stream(dstp + x);
+template void checkSpatial_avx2<uint8_t, Vec32uc, Vec16s, 32>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void checkSpatial_avx2<uint16_t, Vec16us, Vec8i, 16>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
 
-        dstp[-1] = dstp[1];
-        dstp[width] = dstp[width - 2];
+// avg rounds up, so averaging src with the rounded-down mean of prv and nxt gives exactly (prv + 2 * src + nxt + 2) >> 2
+template<typename T2>
+static inline T2 blend121(const T2 & prv, const T2 & src, const T2 & nxt) noexcept {
+    return avg(src, T2((prv & nxt) + ((prv ^ nxt) >> 1)));
+}
 
-        srcp1 += stride;
-        srcp2 += stride;
-        dstp += stride;
-    }
+// (19 * (pp + pn) - 3 * (ppp + pnn) + 16) >> 5 clamped to [0, peak], worked out on the widened halves
+template<typename T2>
+static inline T2 cubic(const T2 & ppp, const T2 & pp, const T2 & pn, const T2 & pnn, const int peak) noexcept {
+    const auto low = ((widen_low(pp) + widen_low(pn)) * 19 - (widen_low(ppp) + widen_low(pnn)) * 3 + 16) >> 5;
+    const auto high = ((widen_high(pp) + widen_high(pn)) * 19 - (widen_high(ppp) + widen_high(pnn)) * 3 + 16) >> 5;
+    return narrow(min(max(low, 0), peak), min(max(high, 0), peak));
 }
 
-template void andMasks_avx2<uint8_t, Vec32uc, 32>(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void andMasks_avx2<uint16_t, Vec16us, 16>(const VSFrameRef *, const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+// every mask value picks its own source, mask values outside the table leave dst untouched
+template<typename T2>
+static inline T2 temporal_blend(const T2 & mask, const T2 & prv, const T2 & src, const T2 & nxt, T2 dst) noexcept {
+    dst = select(mask == T2(10), src, dst);
+    dst = select(mask == T2(20), prv, dst);
+    dst = select(mask == T2(30), nxt, dst);
+    dst = select(mask == T2(40), avg(src, nxt), dst);
+    dst = select(mask == T2(50), avg(src, prv), dst);
+    dst = select(mask == T2(70), blend121(prv, src, nxt), dst);
+    return dst;
+}
 
 template<typename T1, typename T2, int step>
-void combineMasks_avx2(const VSFrameRef * src, VSFrameRef * dst, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
-    constexpr T1 peak = std::numeric_limits<T1>::max();
+void eDeint_avx2(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef * prv, const VSFrameRef * src, const VSFrameRef * nxt, const VSFrameRef * edeint,
+                 const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = vsapi->getFrameWidth(src, plane);
+            const int height = vsapi->getFrameHeight(src, plane);
+            const int stride = vsapi->getStride(src, plane) / sizeof(T1);
+            const int maskStride = vsapi->getStride(mask, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T1 * prvp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(prv, plane)) + stride * rows.first;
+            const T1 * srcp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            const T1 * nxtp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(nxt, plane)) + stride * rows.first;
+            const uint8_t * maskp = vsapi->getReadPtr(mask, plane) + maskStride * rows.first;
+            const T1 * edeintp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(edeint, plane)) + stride * rows.first;
+            T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, plane)) + stride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
+                for (int x = 0; x < width; x += step) {
+                    const T2 codes = mask_codes(maskp + x, T2());
+                    const T2 blended = temporal_blend(codes, T2().load_a(prvp + x), T2().load_a(srcp + x), T2().load_a(nxtp + x), T2().load_a(dstp + x));
+                    select(codes == T2(60), T2().load_a(edeintp + x), blended).store_a(dstp + x);
+                }
+
+                prvp += stride;
+                srcp += stride;
+                nxtp += stride;
+                maskp += maskStride;
+                edeintp += stride;
+                dstp += stride;
+            }
+        }
+    }
+}
 
-    const int width = vsapi->getFrameWidth(dst, plane);
-    const int height = vsapi->getFrameHeight(dst, plane);
-    const int srcStride = vsapi->getStride(src, 0) / sizeof(T1);
-    const int dstStride = vsapi->getStride(dst, plane) / sizeof(T1);
-    const T1 * srcp0 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
-    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, plane));
+template void eDeint_avx2<uint8_t, Vec32uc, 32>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void eDeint_avx2<uint16_t, Vec16us, 16>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
 
-    const T1 * srcpp0 = srcp0 + srcStride;
-    const T1 * srcpn0 = srcpp0;
-    const T1 * srcp1 = srcp0 + srcStride * height;
+template<typename T1, typename T2, int step>
+void cubicDeint_avx2(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef * prv, const VSFrameRef * src, const VSFrameRef * nxt,
+                     const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = vsapi->getFrameWidth(src, plane);
+            const int height = vsapi->getFrameHeight(src, plane);
+            const int stride = vsapi->getStride(src, plane) / sizeof(T1);
+            const int maskStride = vsapi->getStride(mask, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T1 * prvp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(prv, plane)) + stride * rows.first;
+            const T1 * srcp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            const T1 * nxtp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(nxt, plane)) + stride * rows.first;
+            const uint8_t * maskp = vsapi->getReadPtr(mask, plane) + maskStride * rows.first;
+            T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, plane)) + stride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
+                // only the taps that stay inside the plane are loaded, so the interpolation is picked once per row
+                const int taps = (y == 0) ? 0 : (y == height - 1) ? 1 : (y < 3 || y > height - 4) ? 2 : 4;
+
+                for (int x = 0; x < width; x += step) {
+                    T2 interp;
+                    if (taps == 0)
+                        interp = T2().load_a(srcp + stride + x);
+                    else if (taps == 1)
+                        interp = T2().load_a(srcp - stride + x);
+                    else if (taps == 2)
+                        interp = avg(T2().load_a(srcp - stride + x), T2().load_a(srcp + stride + x));
+                    else
+                        interp = cubic(T2().load_a(srcp - stride * 3 + x), T2().load_a(srcp - stride + x), T2().load_a(srcp + stride + x), T2().load_a(srcp + stride * 3 + x), d->peak);
+
+                    const T2 codes = mask_codes(maskp + x, T2());
+                    const T2 blended = temporal_blend(codes, T2().load_a(prvp + x), T2().load_a(srcp + x), T2().load_a(nxtp + x), T2().load_a(dstp + x));
+                    select(codes == T2(60), interp, blended).store_a(dstp + x);
+                }
+
+                prvp += stride;
+                srcp += stride;
+                nxtp += stride;
+                maskp += maskStride;
+                dstp += stride;
+            }
+        }
+    }
+}
 
-    vs_bitblt(dstp, vsapi->getStride(dst, plane), srcp0, vsapi->getStride(src, 0), width * sizeof(T1), height);
+template void cubicDeint_avx2<uint8_t, Vec32uc, 32>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void cubicDeint_avx2<uint16_t, Vec16us, 16>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+void expandMask_avx2(VSFrameRef * mask, const int field, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    auto scratch = d->scratch->scope();
+
+    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+        const int dis = d->expand >> (plane ? d->vi.format->subSamplingW : 0);
+
+        if (d->process[plane] && dis > 0) {
+            const int width = vsapi->getFrameWidth(mask, plane);
+            const int height = vsapi->getFrameHeight(mask, plane);
+            const int stride = vsapi->getStride(mask, plane) * 2;
+            const auto rows = stripRows((height - field + 1) / 2, strip, d);
+            uint8_t * VS_RESTRICT maskp = vsapi->getWritePtr(mask, plane) + stride / 2 * field + stride * rows.first;
+
+            // the window of 2 * dis + 1 pixels is covered by two overlapping runs of span pixels, span being a power of two
+            const int window = dis * 2 + 1;
+            int span = 1;
+            while (span * 2 <= window)
+                span *= 2;
+
+            // flags of the 60s, dis zeros in front and enough zeros behind for every read past the row
+            const int size = width + dis * 2;
+            uint8_t * flags = scratch.alloc<uint8_t>(size + window + 32 * 2);
+
+            for (int y = rows.first; y < rows.second; y++) {
+                std::fill_n(flags, dis, static_cast<uint8_t>(0));
+                for (int x = 0; x < width; x += 32)
+                    Vec32uc(Vec32uc().load_a(maskp + x) == 60).store(flags + dis + x);
+                std::fill_n(flags + dis + width, dis + window + 32 * 2, static_cast<uint8_t>(0));
+
+                // every pass doubles the run a flag covers. Going forward the flags w further on are still those of the previous pass.
+                for (int w = 1; w < span; w *= 2) {
+                    for (int x = 0; x < size; x += 32)
+                        (Vec32uc().load(flags + x) | Vec32uc().load(flags + x + w)).store(flags + x);
+                }
+
+                for (int x = 0; x < width; x += 32) {
+                    const Vec32uc combed = Vec32uc().load(flags + x) | Vec32uc().load(flags + x + window - span);
+                    const Vec32uc m = Vec32uc().load_a(maskp + x);
+                    Vec32uc(m ^ ((m ^ 60) & combed)).store_a(maskp + x);
+                }
+
+                maskp += stride;
+            }
+        }
+    }
+}
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x += step) {
-            const T2 count = T2().load(srcpp0 + x - 1) + T2().load_a(srcpp0 + x) + T2().load(srcpp0 + x + 1) +
-                             T2().load(srcp0 + x - 1) + T2().load(srcp0 + x + 1) +
-                             T2().load(srcpn0 + x - 1) + T2().load_a(srcpn0 + x) + T2().load(srcpn0 + x + 1);
-            select(T2().load_a(srcp0 + x) == T2(zero_256b()) && T2().load_a(srcp1 + x) != T2(zero_256b()) && count >= d->cstr, peak, T2().load_a(dstp + x)).stream(dstp + x);
+template<int ssw, int ssh>
+void linkMask_avx2(VSFrameRef * mask, const int field, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    const int width = vsapi->getFrameWidth(mask, 2);
+    const int height = vsapi->getFrameHeight(mask, 2);
+    const int strideY = vsapi->getStride(mask, 0);
+    const int strideUV = vsapi->getStride(mask, 2);
+    const int strideY2 = strideY * (2 << ssh);
+    const int strideUV2 = strideUV * 2;
+    const auto rows = stripRows((height - field + 1) / 2, strip, d);
+
+    const uint8_t * maskpY = vsapi->getReadPtr(mask, 0) + strideY * field + strideY2 * rows.first;
+    uint8_t * VS_RESTRICT maskpU = vsapi->getWritePtr(mask, 1) + strideUV * field + strideUV2 * rows.first;
+    uint8_t * VS_RESTRICT maskpV = vsapi->getWritePtr(mask, 2) + strideUV * field + strideUV2 * rows.first;
+
+    const uint8_t * maskpnY = maskpY + strideY * 2;
+
+    for (int y = rows.first; y < rows.second; y++) {
+        if (ssw == 0) {
+            for (int x = 0; x < width; x += 32) {
+                Vec32uc combed = Vec32uc(Vec32uc().load_a(maskpY + x) == 0x3C);
+                if (ssh)
+                    combed &= Vec32uc(Vec32uc().load_a(maskpnY + x) == 0x3C);
+
+                const Vec32uc u = Vec32uc().load_a(maskpU + x);
+                const Vec32uc v = Vec32uc().load_a(maskpV + x);
+                Vec32uc(u ^ ((u ^ 0x3C) & combed)).store_a(maskpU + x);
+                Vec32uc(v ^ ((v ^ 0x3C) & combed)).store_a(maskpV + x);
+            }
+        } else {
+            // a chroma pixel takes the two luma pixels of a 16-bit lane. Half as many chroma pixels per step keeps the luma reads inside the row.
+            for (int x = 0; x < width; x += 16) {
+                Vec16s both = Vec16us().load_a(maskpY + x * 2) == Vec16us(0x3C3C);
+                if (ssh)
+                    both &= Vec16us().load_a(maskpnY + x * 2) == Vec16us(0x3C3C);
+
+                const Vec16uc combed = Vec16uc(compress(both.get_low(), both.get_high()));
+                const Vec16uc u = Vec16uc().load_a(maskpU + x);
+                const Vec16uc v = Vec16uc().load_a(maskpV + x);
+                Vec16uc(u ^ ((u ^ 0x3C) & combed)).store_a(maskpU + x);
+                Vec16uc(v ^ ((v ^ 0x3C) & combed)).store_a(maskpV + x);
+            }
         }
 
-        srcpp0 = srcp0;
-        srcp0 = srcpn0;
-        srcpn0 += (y < height - 2) ? srcStride : -srcStride;
-        srcp1 += srcStride;
-        dstp += dstStride;
+        maskpY += strideY2;
+        maskpnY += strideY2;
+        maskpU += strideUV2;
+        maskpV += strideUV2;
+    }
+}
+
+template void linkMask_avx2<0, 0>(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void linkMask_avx2<0, 1>(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void linkMask_avx2<1, 0>(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void linkMask_avx2<1, 1>(VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+// The comb test of IsCombed on the differences of a pixel from the pixels above and below, and with metric 0 the five tap sum
+template<typename T3>
+static inline T3 mask_combed(const T3 & first, const T3 & second, const T3 & cubic, const CombMask & m) noexcept {
+    if (m.metric == 0)
+        return (((first > T3(m.cthresh)) & (second > T3(m.cthresh))) | ((first < T3(-m.cthresh)) & (second < T3(-m.cthresh)))) & (cubic > T3(m.cthresh6));
+    // lanes of opposite sign are rejected here, a zero lane already fails the product test
+    return ((first ^ second) >= T3(0)) & product_gt(first, second, m.cthreshsq);
+}
+
+template<typename T1, typename T2, typename T3, int step>
+void combRow_avx2(const uint8_t * srcRow, const int srcStride, const int y, const int height, const int width, uint8_t * const * dstRows, const IsCombedData * d) noexcept {
+    const int stride = srcStride / sizeof(T1);
+    const T1 * srcp = reinterpret_cast<const T1 *>(srcRow);
+
+    // rows past the top and bottom are mirrored
+    const T1 * srcppp = srcp + stride * (y > 1 ? -2 : 2);
+    const T1 * srcpp = srcp + stride * (y > 0 ? -1 : 1);
+    const T1 * srcpn = srcp + stride * (y < height - 1 ? 1 : -1);
+    const T1 * srcpnn = srcp + stride * (y < height - 2 ? 2 : -2);
+
+    const CombMask * masks = d->masks.data();
+    const int count = static_cast<int>(d->masks.size());
+    const bool cubic = std::any_of(masks, masks + count, [](const CombMask & m) { return m.metric == 0; });
+
+    for (int x = 0; x < width; x += step) {
+        const T2 ppp = T2().load_a(srcppp + x);
+        const T2 pp = T2().load_a(srcpp + x);
+        const T2 c = T2().load_a(srcp + x);
+        const T2 pn = T2().load_a(srcpn + x);
+        const T2 pnn = T2().load_a(srcpnn + x);
+
+        // the differences are worked out once for all the masks
+        const T3 firstLow = widen_low(c) - widen_low(pp);
+        const T3 firstHigh = widen_high(c) - widen_high(pp);
+        const T3 secondLow = widen_low(c) - widen_low(pn);
+        const T3 secondHigh = widen_high(c) - widen_high(pn);
+        const T3 cubicLow = cubic ? abs(widen_low(ppp) + widen_low(c) * 4 + widen_low(pnn) - (widen_low(pp) + widen_low(pn)) * 3) : T3(0);
+        const T3 cubicHigh = cubic ? abs(widen_high(ppp) + widen_high(c) * 4 + widen_high(pnn) - (widen_high(pp) + widen_high(pn)) * 3) : T3(0);
+
+        // all ones is the peak of the mask
+        for (int k = 0; k < count; k++)
+            narrow(mask_combed(firstLow, secondLow, cubicLow, masks[k]), mask_combed(firstHigh, secondHigh, cubicHigh, masks[k])).store_a(reinterpret_cast<T1 *>(dstRows[k]) + x);
+    }
+}
+
+template void combRow_avx2<uint8_t, Vec32uc, Vec16s, 32>(const uint8_t *, const int, const int, const int, const int, uint8_t * const *, const IsCombedData *) noexcept;
+template void combRow_avx2<uint16_t, Vec16us, Vec8i, 16>(const uint8_t *, const int, const int, const int, const int, uint8_t * const *, const IsCombedData *) noexcept;
+
+// The comb mask is either 0 or all ones, so a pixel is combed along with a neighbour when it is and-ed with the or of the eight around it
+template<typename T2, typename T1>
+static inline T2 chroma_combed(const T1 * pp, const T1 * p, const T1 * pn) noexcept {
+    const T2 around = T2().load(pp - 1) | T2().load(pp) | T2().load(pp + 1) | T2().load(p - 1) | T2().load(p + 1) |
+                      T2().load(pn - 1) | T2().load(pn) | T2().load(pn + 1);
+    return T2().load(p) & around;
+}
+
+// ors the lanes into the luma row, every lane sign extended to cover the 1 << ssw luma pixels below it
+template<typename V>
+static inline void spread(uint8_t * p, const V & v, std::integral_constant<int, 0>) noexcept {
+    (V().load(p) | v).store(p);
+}
+
+template<typename V, int ssw>
+static inline void spread(uint8_t * p, const V & v, std::integral_constant<int, ssw>) noexcept {
+    spread(p, extend_low(v), std::integral_constant<int, ssw - 1>());
+    spread(p + (sizeof(V) << (ssw - 1)), extend_high(v), std::integral_constant<int, ssw - 1>());
+}
+
+template<typename T1, typename T2, typename T3, int step, int ssw>
+void linkRow_avx2(const uint8_t * const * rowsU, const uint8_t * const * rowsV, const int width, uint8_t * const * luma, const int count, const IsCombedData *) noexcept {
+    const T1 * cmkppU = reinterpret_cast<const T1 *>(rowsU[0]);
+    const T1 * cmkpU = reinterpret_cast<const T1 *>(rowsU[1]);
+    const T1 * cmkpnU = reinterpret_cast<const T1 *>(rowsU[2]);
+    const T1 * cmkppV = reinterpret_cast<const T1 *>(rowsV[0]);
+    const T1 * cmkpV = reinterpret_cast<const T1 *>(rowsV[1]);
+    const T1 * cmkpnV = reinterpret_cast<const T1 *>(rowsV[2]);
+
+    for (int x = 1; x < width - 1; x += step) {
+        // the last vector is moved back to end on the last pixel with two neighbours, marking some pixels twice does no harm
+        const int xs = std::min(x, width - 1 - step);
+        const T2 combed = chroma_combed<T2>(cmkppU + xs, cmkpU + xs, cmkpnU + xs) | chroma_combed<T2>(cmkppV + xs, cmkpV + xs, cmkpnV + xs);
+        if (!horizontal_or(combed))
+            continue;
+
+        for (int i = 0; i < count; i++)
+            spread(luma[i] + (xs << ssw) * sizeof(T1), T3(combed), std::integral_constant<int, ssw>());
+    }
+}
+
+template void linkRow_avx2<uint8_t, Vec32uc, Vec32c, 32, 0>(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+template void linkRow_avx2<uint8_t, Vec32uc, Vec32c, 32, 1>(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+template void linkRow_avx2<uint8_t, Vec32uc, Vec32c, 32, 2>(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+template void linkRow_avx2<uint16_t, Vec16us, Vec16s, 16, 0>(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+template void linkRow_avx2<uint16_t, Vec16us, Vec16s, 16, 1>(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+template void linkRow_avx2<uint16_t, Vec16us, Vec16s, 16, 2>(const uint8_t * const *, const uint8_t * const *, const int, uint8_t * const *, const int, const IsCombedData *) noexcept;
+
+// Adds the counts of a band to the 16-bit column counts, which start from nothing when `init` is set
+static inline void add_columns(uint16_t * p, const Vec16us & count, const bool init) noexcept {
+    (init ? count : Vec16us().load(p) + count).store(p);
+}
+
+static inline void add_columns(uint16_t * p, const Vec32uc & count, const bool init) noexcept {
+    add_columns(p, extend_low(count), init);
+    add_columns(p + 16, extend_high(count), init);
+}
+
+template<typename T1, typename T2, int step>
+void countBand_avx2(const uint8_t * const * rows, const int count, const int width, uint16_t * VS_RESTRICT columns) noexcept {
+    // the lanes of a band count up to their maximum before they are added to the columns
+    constexpr int chunk = std::numeric_limits<T1>::max();
+
+    for (int x = 0; x < width; x += step) {
+        T2 prv = T2().load_a(reinterpret_cast<const T1 *>(rows[0]) + x);
+        T2 cur = T2().load_a(reinterpret_cast<const T1 *>(rows[1]) + x);
+
+        for (int y = 0; y < count; y += chunk) {
+            T2 hits = T2(0);
+
+            for (int u = y; u < std::min(y + chunk, count); u++) {
+                const T2 nxt = T2().load_a(reinterpret_cast<const T1 *>(rows[u + 2]) + x);
+                // a combed pixel is all ones, which counts as minus one
+                hits = hits - (prv & cur & nxt);
+                prv = cur;
+                cur = nxt;
+            }
+
+            add_columns(columns + x, hits, y == 0);
+        }
     }
 }
 
-template void combineMasks_avx2<uint8_t, Vec32uc, 32>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
-template void combineMasks_avx2<uint16_t, Vec16us, 16>(const VSFrameRef *, VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void countBand_avx2<uint8_t, Vec32uc, 32>(const uint8_t * const *, const int, const int, uint16_t *) noexcept;
+template void countBand_avx2<uint16_t, Vec16us, 16>(const uint8_t * const *, const int, const int, uint16_t *) noexcept;
 #endif
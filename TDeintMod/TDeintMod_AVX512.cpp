@@ -0,0 +1,246 @@
+#ifdef VS_TARGET_CPU_X86
+#ifndef __AVX512F__
+#define __AVX512F__
+#endif
+#ifndef __AVX512BW__
+#define __AVX512BW__
+#endif
+#ifndef __AVX512DQ__
+#define __AVX512DQ__
+#endif
+#ifndef __AVX512VL__
+#define __AVX512VL__
+#endif
+
+#define MAX_VECTOR_SIZE 512
+
+#include "TDeintMod.hpp"
+
+// The rows of the padded fields are only guaranteed to be 32-byte aligned, so all loads and stores here are unaligned ones.
+// They cost nothing extra when the data does happen to sit on a 64-byte boundary.
+
+template<typename T>
+static inline T abs_dif(const T & a, const T & b) noexcept {
+    return sub_saturated(a, b) | sub_saturated(b, a);
+}
+
+template<typename T1, typename T2, int step>
+void threshMask_avx512(const VSFrameRef * src, VSFrameRef * dst, const int plane, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    constexpr T1 peak = std::numeric_limits<T1>::max();
+
+    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
+    const int stride = vsapi->getStride(src, 0) / sizeof(T1);
+    const T1 * srcp = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
+    T1 * dstp0 = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
+    T1 * dstp1 = dstp0 + stride * height;
+
+    const auto rows = stripRows(height, strip, d);
+
+    if (plane == 0 && d->mtqL > -1 && d->mthL > -1) {
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mtqL));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mthL));
+        return;
+    } else if (plane > 0 && d->mtqC > -1 && d->mthC > -1) {
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mtqC));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T1>(d->mthC));
+        return;
+    }
+
+    // the rows above and below the strip are read in place, mirrored at the plane edges
+    srcp += stride * rows.first;
+    dstp0 += stride * rows.first;
+    dstp1 += stride * rows.first;
+    const T1 * srcpp = rows.first ? srcp - stride : srcp + stride;
+    const T1 * srcpn = (rows.first > 0 && rows.first == height - 1) ? srcp - stride : srcp + stride;
+
+    for (int y = rows.first; y < rows.second; y++) {
+        for (int x = 0; x < width; x += step) {
+            const T2 topLeft = T2().load(srcpp + x - 1);
+            const T2 top = T2().load(srcpp + x);
+            const T2 topRight = T2().load(srcpp + x + 1);
+            const T2 left = T2().load(srcp + x - 1);
+            const T2 center = T2().load(srcp + x);
+            const T2 right = T2().load(srcp + x + 1);
+            const T2 bottomLeft = T2().load(srcpn + x - 1);
+            const T2 bottom = T2().load(srcpn + x);
+            const T2 bottomRight = T2().load(srcpn + x + 1);
+
+            T2 min0 = peak, max0 = T2(0);
+            T2 min1 = peak, max1 = T2(0);
+
+            if (d->ttype == 0) { // 4 neighbors - compensated
+                min0 = min(min0, top);
+                max0 = max(max0, top);
+                min1 = min(min1, left);
+                max1 = max(max1, left);
+                min1 = min(min1, right);
+                max1 = max(max1, right);
+                min0 = min(min0, bottom);
+                max0 = max(max0, bottom);
+
+                const T2 atv = max((abs_dif<T2>(center, min0) + d->vHalf[plane]) >> d->vShift[plane], (abs_dif<T2>(center, max0) + d->vHalf[plane]) >> d->vShift[plane]);
+                const T2 ath = max((abs_dif<T2>(center, min1) + d->hHalf[plane]) >> d->hShift[plane], (abs_dif<T2>(center, max1) + d->hHalf[plane]) >> d->hShift[plane]);
+                const T2 atmax = max(atv, ath);
+                ((atmax + 2) >> 2).store(dstp0 + x);
+                ((atmax + 1) >> 1).store(dstp1 + x);
+            } else if (d->ttype == 1) { // 8 neighbors - compensated
+                min0 = min(min0, topLeft);
+                max0 = max(max0, topLeft);
+                min0 = min(min0, top);
+                max0 = max(max0, top);
+                min0 = min(min0, topRight);
+                max0 = max(max0, topRight);
+                min1 = min(min1, left);
+                max1 = max(max1, left);
+                min1 = min(min1, right);
+                max1 = max(max1, right);
+                min0 = min(min0, bottomLeft);
+                max0 = max(max0, bottomLeft);
+                min0 = min(min0, bottom);
+                max0 = max(max0, bottom);
+                min0 = min(min0, bottomRight);
+                max0 = max(max0, bottomRight);
+
+                const T2 atv = max((abs_dif<T2>(center, min0) + d->vHalf[plane]) >> d->vShift[plane], (abs_dif<T2>(center, max0) + d->vHalf[plane]) >> d->vShift[plane]);
+                const T2 ath = max((abs_dif<T2>(center, min1) + d->hHalf[plane]) >> d->hShift[plane], (abs_dif<T2>(center, max1) + d->hHalf[plane]) >> d->hShift[plane]);
+                const T2 atmax = max(atv, ath);
+                ((atmax + 2) >> 2).store(dstp0 + x);
+                ((atmax + 1) >> 1).store(dstp1 + x);
+            } else if (d->ttype == 2) { // 4 neighbors - not compensated
+                min0 = min(min0, top);
+                max0 = max(max0, top);
+                min0 = min(min0, left);
+                max0 = max(max0, left);
+                min0 = min(min0, right);
+                max0 = max(max0, right);
+                min0 = min(min0, bottom);
+                max0 = max(max0, bottom);
+
+                const T2 at = max(abs_dif<T2>(center, min0), abs_dif<T2>(center, max0));
+                ((at + 2) >> 2).store(dstp0 + x);
+                ((at + 1) >> 1).store(dstp1 + x);
+            } else if (d->ttype == 3) { // 8 neighbors - not compensated
+                min0 = min(min0, topLeft);
+                max0 = max(max0, topLeft);
+                min0 = min(min0, top);
+                max0 = max(max0, top);
+                min0 = min(min0, topRight);
+                max0 = max(max0, topRight);
+                min0 = min(min0, left);
+                max0 = max(max0, left);
+                min0 = min(min0, right);
+                max0 = max(max0, right);
+                min0 = min(min0, bottomLeft);
+                max0 = max(max0, bottomLeft);
+                min0 = min(min0, bottom);
+                max0 = max(max0, bottom);
+                min0 = min(min0, bottomRight);
+                max0 = max(max0, bottomRight);
+
+                const T2 at = max(abs_dif<T2>(center, min0), abs_dif<T2>(center, max0));
+                ((at + 2) >> 2).store(dstp0 + x);
+                ((at + 1) >> 1).store(dstp1 + x);
+            } else if (d->ttype == 4) { // 4 neighbors - not compensated (range)
+                min0 = min(min0, top);
+                max0 = max(max0, top);
+                min0 = min(min0, left);
+                max0 = max(max0, left);
+                min0 = min(min0, center);
+                max0 = max(max0, center);
+                min0 = min(min0, right);
+                max0 = max(max0, right);
+                min0 = min(min0, bottom);
+                max0 = max(max0, bottom);
+
+                const T2 at = max0 - min0;
+                ((at + 2) >> 2).store(dstp0 + x);
+                ((at + 1) >> 1).store(dstp1 + x);
+            } else { // 8 neighbors - not compensated (range)
+                min0 = min(min0, topLeft);
+                max0 = max(max0, topLeft);
+                min0 = min(min0, top);
+                max0 = max(max0, top);
+                min0 = min(min0, topRight);
+                max0 = max(max0, topRight);
+                min0 = min(min0, left);
+                max0 = max(max0, left);
+                min0 = min(min0, center);
+                max0 = max(max0, center);
+                min0 = min(min0, right);
+                max0 = max(max0, right);
+                min0 = min(min0, bottomLeft);
+                max0 = max(max0, bottomLeft);
+                min0 = min(min0, bottom);
+                max0 = max(max0, bottom);
+                min0 = min(min0, bottomRight);
+                max0 = max(max0, bottomRight);
+
+                const T2 at = max0 - min0;
+                ((at + 2) >> 2).store(dstp0 + x);
+                ((at + 1) >> 1).store(dstp1 + x);
+            }
+        }
+
+        srcpp = srcp;
+        srcp = srcpn;
+        srcpn += (y < height - 2) ? stride : -stride;
+        dstp0 += stride;
+        dstp1 += stride;
+    }
+
+    T1 * dstp = reinterpret_cast<T1 *>(vsapi->getWritePtr(dst, 0)) + stride * rows.first;
+    if (plane == 0 && d->mtqL > -1)
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T1>(d->mtqL));
+    else if (plane == 0 && d->mthL > -1)
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T1>(d->mthL));
+    else if (plane > 0 && d->mtqC > -1)
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T1>(d->mtqC));
+    else if (plane > 0 && d->mthC > -1)
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T1>(d->mthC));
+}
+
+template void threshMask_avx512<uint8_t, Vec64uc, 64>(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void threshMask_avx512<uint16_t, Vec32us, 32>(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+template<typename T1, typename T2, int step>
+void packMotion_avx512(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, uint64_t * dstpq, uint64_t * dstph,
+                     const int y, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
+    const int stride = vsapi->getStride(src1, 0) / sizeof(T1);
+    const T1 * srcp1 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src1, 0)) + d->widthPad + stride * y;
+    const T1 * srcp2 = reinterpret_cast<const T1 *>(vsapi->getReadPtr(src2, 0)) + d->widthPad + stride * y;
+    const T1 * mskp1q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad + stride * y;
+    const T1 * mskp2q = reinterpret_cast<const T1 *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad + stride * y;
+    const T1 * mskp1h = mskp1q + stride * height;
+    const T1 * mskp2h = mskp2q + stride * height;
+
+    uint64_t bitsq = 0, bitsh = 0;
+
+    for (int x = 0; x < width; x += step) {
+        const T2 diff = abs_dif<T2>(T2().load(srcp1 + x), T2().load(srcp2 + x));
+        const T2 minq = min(T2().load(mskp1q + x), T2().load(mskp2q + x));
+        const T2 minh = min(T2().load(mskp1h + x), T2().load(mskp2h + x));
+        const T2 threshq = min(max(add_saturated(minq, d->nt), d->minthresh), d->maxthresh);
+        const T2 threshh = min(max(add_saturated(minh, d->nt), d->minthresh), d->maxthresh);
+        bitsq |= static_cast<uint64_t>(to_bits(diff <= threshq)) << (x & 63);
+        bitsh |= static_cast<uint64_t>(to_bits(diff <= threshh)) << (x & 63);
+
+        if (((x + step) & 63) == 0 || x + step >= width) {
+            dstpq[x >> 6] = bitsq;
+            dstph[x >> 6] = bitsh;
+            bitsq = bitsh = 0;
+        }
+    }
+
+    if (width & 63) {
+        const uint64_t valid = (static_cast<uint64_t>(1) << (width & 63)) - 1;
+        dstpq[width >> 6] &= valid;
+        dstph[width >> 6] &= valid;
+    }
+}
+
+template void packMotion_avx512<uint8_t, Vec64uc, 64>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void packMotion_avx512<uint16_t, Vec32us, 32>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+#endif
@@ -0,0 +1,357 @@
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+
+#include "TDeintMod.hpp"
+
+// The kernels are written once against these per-sample-type wrappers. Rounding shifts (vrshl/vrshr/vqrshrun) give exactly
+// the (x + half) >> shift of the C code without any intermediate overflow, so this tier matches the C output bit for bit.
+template<typename T> struct Neon;
+
+template<>
+struct Neon<uint8_t> {
+    using V = uint8x16_t;
+    static constexpr int step = 16;
+
+    static V load(const uint8_t * p) noexcept { return vld1q_u8(p); }
+    static V loadMask(const uint8_t * p) noexcept { return vld1q_u8(p); }
+    static void store(uint8_t * p, const V a) noexcept { vst1q_u8(p, a); }
+    static V dup(const int a) noexcept { return vdupq_n_u8(static_cast<uint8_t>(a)); }
+
+    static V min(const V a, const V b) noexcept { return vminq_u8(a, b); }
+    static V max(const V a, const V b) noexcept { return vmaxq_u8(a, b); }
+    static V abd(const V a, const V b) noexcept { return vabdq_u8(a, b); }
+    static V sub(const V a, const V b) noexcept { return vsubq_u8(a, b); }
+    static V addSat(const V a, const V b) noexcept { return vqaddq_u8(a, b); }
+    static V avg(const V a, const V b) noexcept { return vrhaddq_u8(a, b); }
+    static V roundShift(const V a, const int shift) noexcept { return vrshlq_u8(a, vdupq_n_s8(static_cast<int8_t>(-shift))); }
+    static V roundShift1(const V a) noexcept { return vrshrq_n_u8(a, 1); }
+    static V roundShift2(const V a) noexcept { return vrshrq_n_u8(a, 2); }
+    static V cmpLe(const V a, const V b) noexcept { return vcleq_u8(a, b); }
+    static V cmpEq(const V a, const V b) noexcept { return vceqq_u8(a, b); }
+    static V blend(const V mask, const V a, const V b) noexcept { return vbslq_u8(mask, a, b); }
+
+    // one bit per lane, lane 0 in bit 0
+    static uint64_t bits(const V mask) noexcept {
+        static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+        const V masked = vandq_u8(mask, vld1q_u8(weights));
+        uint8x8_t sum = vpadd_u8(vget_low_u8(masked), vget_high_u8(masked));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        return vget_lane_u8(sum, 0) | (static_cast<uint64_t>(vget_lane_u8(sum, 1)) << 8);
+    }
+
+    // (a + b * 2 + c + 2) >> 2
+    static V blend121(const V a, const V b, const V c) noexcept {
+        const uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(c)), vshll_n_u8(vget_low_u8(b), 1));
+        const uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(c)), vshll_n_u8(vget_high_u8(b), 1));
+        return vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2));
+    }
+
+    // clamp((19 * (pp + pn) - 3 * (ppp + pnn) + 16) >> 5, 0, 255), the clamp comes with the saturating narrow
+    static V cubic(const V ppp, const V pp, const V pn, const V pnn, const int) noexcept {
+        const int16x8_t lo = vsubq_s16(vreinterpretq_s16_u16(vmulq_n_u16(vaddl_u8(vget_low_u8(pp), vget_low_u8(pn)), 19)),
+                                       vreinterpretq_s16_u16(vmulq_n_u16(vaddl_u8(vget_low_u8(ppp), vget_low_u8(pnn)), 3)));
+        const int16x8_t hi = vsubq_s16(vreinterpretq_s16_u16(vmulq_n_u16(vaddl_u8(vget_high_u8(pp), vget_high_u8(pn)), 19)),
+                                       vreinterpretq_s16_u16(vmulq_n_u16(vaddl_u8(vget_high_u8(ppp), vget_high_u8(pnn)), 3)));
+        return vcombine_u8(vqrshrun_n_s16(lo, 5), vqrshrun_n_s16(hi, 5));
+    }
+};
+
+template<>
+struct Neon<uint16_t> {
+    using V = uint16x8_t;
+    static constexpr int step = 8;
+
+    static V load(const uint16_t * p) noexcept { return vld1q_u16(p); }
+    static V loadMask(const uint8_t * p) noexcept { return vmovl_u8(vld1_u8(p)); }
+    static void store(uint16_t * p, const V a) noexcept { vst1q_u16(p, a); }
+    static V dup(const int a) noexcept { return vdupq_n_u16(static_cast<uint16_t>(a)); }
+
+    static V min(const V a, const V b) noexcept { return vminq_u16(a, b); }
+    static V max(const V a, const V b) noexcept { return vmaxq_u16(a, b); }
+    static V abd(const V a, const V b) noexcept { return vabdq_u16(a, b); }
+    static V sub(const V a, const V b) noexcept { return vsubq_u16(a, b); }
+    static V addSat(const V a, const V b) noexcept { return vqaddq_u16(a, b); }
+    static V avg(const V a, const V b) noexcept { return vrhaddq_u16(a, b); }
+    static V roundShift(const V a, const int shift) noexcept { return vrshlq_u16(a, vdupq_n_s16(static_cast<int16_t>(-shift))); }
+    static V roundShift1(const V a) noexcept { return vrshrq_n_u16(a, 1); }
+    static V roundShift2(const V a) noexcept { return vrshrq_n_u16(a, 2); }
+    static V cmpLe(const V a, const V b) noexcept { return vcleq_u16(a, b); }
+    static V cmpEq(const V a, const V b) noexcept { return vceqq_u16(a, b); }
+    static V blend(const V mask, const V a, const V b) noexcept { return vbslq_u16(mask, a, b); }
+
+    static uint64_t bits(const V mask) noexcept {
+        static const uint8_t weights[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+        uint8x8_t sum = vand_u8(vmovn_u16(mask), vld1_u8(weights));
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        sum = vpadd_u8(sum, sum);
+        return vget_lane_u8(sum, 0);
+    }
+
+    static V blend121(const V a, const V b, const V c) noexcept {
+        const uint32x4_t lo = vaddq_u32(vaddl_u16(vget_low_u16(a), vget_low_u16(c)), vshll_n_u16(vget_low_u16(b), 1));
+        const uint32x4_t hi = vaddq_u32(vaddl_u16(vget_high_u16(a), vget_high_u16(c)), vshll_n_u16(vget_high_u16(b), 1));
+        return vcombine_u16(vrshrn_n_u32(lo, 2), vrshrn_n_u32(hi, 2));
+    }
+
+    static V cubic(const V ppp, const V pp, const V pn, const V pnn, const int peak) noexcept {
+        const int32x4_t lo = vreinterpretq_s32_u32(vmlsq_n_u32(vmulq_n_u32(vaddl_u16(vget_low_u16(pp), vget_low_u16(pn)), 19),
+                                                               vaddl_u16(vget_low_u16(ppp), vget_low_u16(pnn)), 3));
+        const int32x4_t hi = vreinterpretq_s32_u32(vmlsq_n_u32(vmulq_n_u32(vaddl_u16(vget_high_u16(pp), vget_high_u16(pn)), 19),
+                                                               vaddl_u16(vget_high_u16(ppp), vget_high_u16(pnn)), 3));
+        return vminq_u16(vcombine_u16(vqrshrun_n_s32(lo, 5), vqrshrun_n_s32(hi, 5)), dup(peak));
+    }
+};
+
+template<typename T>
+void threshMask_neon(const VSFrameRef * src, VSFrameRef * dst, const int plane, const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    using N = Neon<T>;
+    using V = typename N::V;
+
+    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
+    const int stride = vsapi->getStride(src, 0) / sizeof(T);
+    const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, 0)) + d->widthPad;
+    T * dstp0 = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + d->widthPad;
+    T * dstp1 = dstp0 + stride * height;
+
+    const auto rows = stripRows(height, strip, d);
+
+    if (plane == 0 && d->mtqL > -1 && d->mthL > -1) {
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mtqL));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mthL));
+        return;
+    } else if (plane > 0 && d->mtqC > -1 && d->mthC > -1) {
+        std::fill_n(dstp0 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mtqC));
+        std::fill_n(dstp1 - d->widthPad + stride * rows.first, stride * (rows.second - rows.first), static_cast<T>(d->mthC));
+        return;
+    }
+
+    // the rows above and below the strip are read in place, mirrored at the plane edges
+    srcp += stride * rows.first;
+    dstp0 += stride * rows.first;
+    dstp1 += stride * rows.first;
+    const T * srcpp = rows.first ? srcp - stride : srcp + stride;
+    const T * srcpn = (rows.first > 0 && rows.first == height - 1) ? srcp - stride : srcp + stride;
+
+    const bool diagonals = d->ttype & 1;
+
+    for (int y = rows.first; y < rows.second; y++) {
+        for (int x = 0; x < width; x += N::step) {
+            const V top = N::load(srcpp + x);
+            const V left = N::load(srcp + x - 1);
+            const V center = N::load(srcp + x);
+            const V right = N::load(srcp + x + 1);
+            const V bottom = N::load(srcpn + x);
+
+            V minV = N::min(top, bottom), maxV = N::max(top, bottom);
+            if (diagonals) {
+                const V topLeft = N::load(srcpp + x - 1);
+                const V topRight = N::load(srcpp + x + 1);
+                const V bottomLeft = N::load(srcpn + x - 1);
+                const V bottomRight = N::load(srcpn + x + 1);
+                minV = N::min(N::min(minV, N::min(topLeft, topRight)), N::min(bottomLeft, bottomRight));
+                maxV = N::max(N::max(maxV, N::max(topLeft, topRight)), N::max(bottomLeft, bottomRight));
+            }
+
+            V at;
+            if (d->ttype < 2) { // compensated, the horizontal neighbours are measured on their own
+                const V minH = N::min(left, right), maxH = N::max(left, right);
+                const V atv = N::max(N::roundShift(N::abd(center, minV), d->vShift[plane]), N::roundShift(N::abd(center, maxV), d->vShift[plane]));
+                const V ath = N::max(N::roundShift(N::abd(center, minH), d->hShift[plane]), N::roundShift(N::abd(center, maxH), d->hShift[plane]));
+                at = N::max(atv, ath);
+            } else if (d->ttype < 4) { // not compensated
+                minV = N::min(minV, N::min(left, right));
+                maxV = N::max(maxV, N::max(left, right));
+                at = N::max(N::abd(center, minV), N::abd(center, maxV));
+            } else { // not compensated (range)
+                minV = N::min(N::min(minV, center), N::min(left, right));
+                maxV = N::max(N::max(maxV, center), N::max(left, right));
+                at = N::sub(maxV, minV);
+            }
+
+            N::store(dstp0 + x, N::roundShift2(at));
+            N::store(dstp1 + x, N::roundShift1(at));
+        }
+
+        srcpp = srcp;
+        srcp = srcpn;
+        srcpn += (y < height - 2) ? stride : -stride;
+        dstp0 += stride;
+        dstp1 += stride;
+    }
+
+    T * dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, 0)) + stride * rows.first;
+    if (plane == 0 && d->mtqL > -1)
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T>(d->mtqL));
+    else if (plane == 0 && d->mthL > -1)
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T>(d->mthL));
+    else if (plane > 0 && d->mtqC > -1)
+        std::fill_n(dstp, stride * (rows.second - rows.first), static_cast<T>(d->mtqC));
+    else if (plane > 0 && d->mthC > -1)
+        std::fill_n(dstp + stride * height, stride * (rows.second - rows.first), static_cast<T>(d->mthC));
+}
+
+template void threshMask_neon<uint8_t>(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void threshMask_neon<uint16_t>(const VSFrameRef *, VSFrameRef *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+template<typename T>
+void packMotion_neon(const VSFrameRef * src1, const VSFrameRef * msk1, const VSFrameRef * src2, const VSFrameRef * msk2, uint64_t * dstpq, uint64_t * dstph,
+                     const int y, const int plane, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    using N = Neon<T>;
+    using V = typename N::V;
+
+    const int width = d->vi.width >> (plane ? d->vi.format->subSamplingW : 0);
+    const int height = (d->vi.height / 2) >> (plane ? d->vi.format->subSamplingH : 0);
+    const int stride = vsapi->getStride(src1, 0) / sizeof(T);
+    const T * srcp1 = reinterpret_cast<const T *>(vsapi->getReadPtr(src1, 0)) + d->widthPad + stride * y;
+    const T * srcp2 = reinterpret_cast<const T *>(vsapi->getReadPtr(src2, 0)) + d->widthPad + stride * y;
+    const T * mskp1q = reinterpret_cast<const T *>(vsapi->getReadPtr(msk1, 0)) + d->widthPad + stride * y;
+    const T * mskp2q = reinterpret_cast<const T *>(vsapi->getReadPtr(msk2, 0)) + d->widthPad + stride * y;
+    const T * mskp1h = mskp1q + stride * height;
+    const T * mskp2h = mskp2q + stride * height;
+
+    const V nt = N::dup(d->nt);
+    const V minthresh = N::dup(d->minthresh);
+    const V maxthresh = N::dup(d->maxthresh);
+
+    uint64_t bitsq = 0, bitsh = 0;
+
+    for (int x = 0; x < width; x += N::step) {
+        const V diff = N::abd(N::load(srcp1 + x), N::load(srcp2 + x));
+        const V minq = N::min(N::load(mskp1q + x), N::load(mskp2q + x));
+        const V minh = N::min(N::load(mskp1h + x), N::load(mskp2h + x));
+        const V threshq = N::min(N::max(N::addSat(minq, nt), minthresh), maxthresh);
+        const V threshh = N::min(N::max(N::addSat(minh, nt), minthresh), maxthresh);
+        bitsq |= N::bits(N::cmpLe(diff, threshq)) << (x & 63);
+        bitsh |= N::bits(N::cmpLe(diff, threshh)) << (x & 63);
+
+        if (((x + N::step) & 63) == 0 || x + N::step >= width) {
+            dstpq[x >> 6] = bitsq;
+            dstph[x >> 6] = bitsh;
+            bitsq = bitsh = 0;
+        }
+    }
+
+    if (width & 63) {
+        const uint64_t valid = (static_cast<uint64_t>(1) << (width & 63)) - 1;
+        dstpq[width >> 6] &= valid;
+        dstph[width >> 6] &= valid;
+    }
+}
+
+template void packMotion_neon<uint8_t>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void packMotion_neon<uint16_t>(const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, uint64_t *, uint64_t *, const int, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+// Every mask value picks its own source, the selects are done with vbsl. Mask values outside the table leave dst untouched.
+template<typename T>
+static inline typename Neon<T>::V temporalBlend(const typename Neon<T>::V mask, const typename Neon<T>::V prv, const typename Neon<T>::V src,
+                                                const typename Neon<T>::V nxt, typename Neon<T>::V dst) noexcept {
+    using N = Neon<T>;
+    dst = N::blend(N::cmpEq(mask, N::dup(10)), src, dst);
+    dst = N::blend(N::cmpEq(mask, N::dup(20)), prv, dst);
+    dst = N::blend(N::cmpEq(mask, N::dup(30)), nxt, dst);
+    dst = N::blend(N::cmpEq(mask, N::dup(40)), N::avg(src, nxt), dst);
+    dst = N::blend(N::cmpEq(mask, N::dup(50)), N::avg(src, prv), dst);
+    dst = N::blend(N::cmpEq(mask, N::dup(70)), N::blend121(prv, src, nxt), dst);
+    return dst;
+}
+
+template<typename T>
+void eDeint_neon(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef * prv, const VSFrameRef * src, const VSFrameRef * nxt, const VSFrameRef * edeint,
+                 const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    using N = Neon<T>;
+    using V = typename N::V;
+
+    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = vsapi->getFrameWidth(src, plane);
+            const int height = vsapi->getFrameHeight(src, plane);
+            const int stride = vsapi->getStride(src, plane) / sizeof(T);
+            const int maskStride = vsapi->getStride(mask, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T * prvp = reinterpret_cast<const T *>(vsapi->getReadPtr(prv, plane)) + stride * rows.first;
+            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            const T * nxtp = reinterpret_cast<const T *>(vsapi->getReadPtr(nxt, plane)) + stride * rows.first;
+            const uint8_t * maskp = vsapi->getReadPtr(mask, plane) + maskStride * rows.first;
+            const T * edeintp = reinterpret_cast<const T *>(vsapi->getReadPtr(edeint, plane)) + stride * rows.first;
+            T * dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane)) + stride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
+                for (int x = 0; x < width; x += N::step) {
+                    const V maskV = N::loadMask(maskp + x);
+                    V dstV = temporalBlend<T>(maskV, N::load(prvp + x), N::load(srcp + x), N::load(nxtp + x), N::load(dstp + x));
+                    dstV = N::blend(N::cmpEq(maskV, N::dup(60)), N::load(edeintp + x), dstV);
+                    N::store(dstp + x, dstV);
+                }
+
+                prvp += stride;
+                srcp += stride;
+                nxtp += stride;
+                maskp += maskStride;
+                edeintp += stride;
+                dstp += stride;
+            }
+        }
+    }
+}
+
+template void eDeint_neon<uint8_t>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void eDeint_neon<uint16_t>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+
+template<typename T>
+void cubicDeint_neon(VSFrameRef * dst, const VSFrameRef * mask, const VSFrameRef * prv, const VSFrameRef * src, const VSFrameRef * nxt,
+                     const int strip, const TDeintModData * d, const VSAPI * vsapi) noexcept {
+    using N = Neon<T>;
+    using V = typename N::V;
+
+    for (int plane = 0; plane < d->vi.format->numPlanes; plane++) {
+        if (d->process[plane]) {
+            const int width = vsapi->getFrameWidth(src, plane);
+            const int height = vsapi->getFrameHeight(src, plane);
+            const int stride = vsapi->getStride(src, plane) / sizeof(T);
+            const int maskStride = vsapi->getStride(mask, plane);
+            const auto rows = stripRows(height, strip, d);
+            const T * prvp = reinterpret_cast<const T *>(vsapi->getReadPtr(prv, plane)) + stride * rows.first;
+            const T * srcp = reinterpret_cast<const T *>(vsapi->getReadPtr(src, plane)) + stride * rows.first;
+            const T * nxtp = reinterpret_cast<const T *>(vsapi->getReadPtr(nxt, plane)) + stride * rows.first;
+            const uint8_t * maskp = vsapi->getReadPtr(mask, plane) + maskStride * rows.first;
+            T * dstp = reinterpret_cast<T *>(vsapi->getWritePtr(dst, plane)) + stride * rows.first;
+
+            for (int y = rows.first; y < rows.second; y++) {
+                // only the taps that stay inside the plane are loaded, so the interpolation is picked once per row
+                const int taps = (y == 0) ? 0 : (y == height - 1) ? 1 : (y < 3 || y > height - 4) ? 2 : 4;
+
+                for (int x = 0; x < width; x += N::step) {
+                    const V maskV = N::loadMask(maskp + x);
+                    const V srcV = N::load(srcp + x);
+
+                    V interp;
+                    if (taps == 0)
+                        interp = N::load(srcp + stride + x);
+                    else if (taps == 1)
+                        interp = N::load(srcp - stride + x);
+                    else if (taps == 2)
+                        interp = N::avg(N::load(srcp - stride + x), N::load(srcp + stride + x));
+                    else
+                        interp = N::cubic(N::load(srcp - stride * 3 + x), N::load(srcp - stride + x), N::load(srcp + stride + x), N::load(srcp + stride * 3 + x), d->peak);
+
+                    V dstV = temporalBlend<T>(maskV, N::load(prvp + x), srcV, N::load(nxtp + x), N::load(dstp + x));
+                    dstV = N::blend(N::cmpEq(maskV, N::dup(60)), interp, dstV);
+                    N::store(dstp + x, dstV);
+                }
+
+                prvp += stride;
+                srcp += stride;
+                nxtp += stride;
+                maskp += maskStride;
+                dstp += stride;
+            }
+        }
+    }
+}
+
+template void cubicDeint_neon<uint8_t>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+template void cubicDeint_neon<uint16_t>(VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const VSFrameRef *, const int, const TDeintModData *, const VSAPI *) noexcept;
+#endif
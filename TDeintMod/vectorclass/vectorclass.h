@@ -62,6 +62,11 @@
   #include "vectori512e.h"   // 512-bit integer vectors, emulated
   #include "vectorf512e.h"   // 512-bit floating point vectors, emulated
 #endif  //  INSTRSET >= 9
+#if INSTRSET >= 10
+  #include "vectori512s.h"   // 512-bit vectors of 8 and 16 bit integers, requires AVX512BW instruction set
+#else
+  #include "vectori512se.h"  // 512-bit vectors of 8 and 16 bit integers, emulated
+#endif  //  INSTRSET >= 10
 #endif  //  MAX_VECTOR_SIZE >= 512
 
 #endif  // INSTRSET >= 2
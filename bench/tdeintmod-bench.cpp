@@ -0,0 +1,617 @@
+/*
+**   Kernel micro-benchmark for TDeintMod and IsCombed
+**
+**   The filters are created through their real create functions against a small in-process VSAPI, which only knows enough
+**   of the API for that and for the kernels, so every kernel runs with exactly the parameters and dispatch the plugin uses.
+**   Each kernel is then timed on synthetic interlaced planes for every bit depth, resolution and instruction set tier the
+**   cpu has, and the results are written to stdout as JSON.
+*/
+
+#include <chrono>
+#include <functional>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "../TDeintMod/TDeintMod.cpp"
+
+//////////////////////////////////////////
+// VSAPI shim
+
+struct VSFrameRef {
+    const VSFormat * format;
+    int width[3], height[3], stride[3];
+    uint8_t * data[3];
+};
+
+struct VSNodeRef {
+    VSVideoInfo vi;
+};
+
+struct VSMap {
+    std::map<std::string, std::vector<int64_t>> ints;
+    std::map<std::string, VSNodeRef *> nodes;
+    std::string error;
+};
+
+// The instance data and free function of the last filter created
+static void * createdData;
+static VSFilterFree createdFree;
+
+static VSFrameRef * VS_CC newVideoFrame(const VSFormat * format, int width, int height, const VSFrameRef * propSrc, VSCore * core) {
+    VSFrameRef * frame = new VSFrameRef{};
+    frame->format = format;
+
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        frame->width[plane] = plane ? width >> format->subSamplingW : width;
+        frame->height[plane] = plane ? height >> format->subSamplingH : height;
+        frame->stride[plane] = (frame->width[plane] * format->bytesPerSample + 63) & ~63;
+        frame->data[plane] = vs_aligned_malloc<uint8_t>(static_cast<size_t>(frame->stride[plane]) * frame->height[plane], 64);
+        memset(frame->data[plane], 0, static_cast<size_t>(frame->stride[plane]) * frame->height[plane]);
+    }
+
+    return frame;
+}
+
+static void VS_CC freeFrame(const VSFrameRef * frame) {
+    if (!frame)
+        return;
+
+    for (int plane = 0; plane < frame->format->numPlanes; plane++)
+        vs_aligned_free(frame->data[plane]);
+    delete frame;
+}
+
+static int VS_CC getStride(const VSFrameRef * frame, int plane) { return frame->stride[plane]; }
+static const uint8_t * VS_CC getReadPtr(const VSFrameRef * frame, int plane) { return frame->data[plane]; }
+static uint8_t * VS_CC getWritePtr(VSFrameRef * frame, int plane) { return frame->data[plane]; }
+static int VS_CC getFrameWidth(const VSFrameRef * frame, int plane) { return frame->width[plane]; }
+static int VS_CC getFrameHeight(const VSFrameRef * frame, int plane) { return frame->height[plane]; }
+static const VSFormat * VS_CC getFrameFormat(const VSFrameRef * frame) { return frame->format; }
+
+static const VSFormat * VS_CC registerFormat(int colorFamily, int sampleType, int bitsPerSample, int subSamplingW, int subSamplingH, VSCore * core) {
+    static std::map<std::tuple<int, int, int, int, int>, VSFormat> formats;
+
+    VSFormat & format = formats[std::make_tuple(colorFamily, sampleType, bitsPerSample, subSamplingW, subSamplingH)];
+    if (!format.id) {
+        format.id = static_cast<int>(formats.size());
+        format.colorFamily = colorFamily;
+        format.sampleType = sampleType;
+        format.bitsPerSample = bitsPerSample;
+        format.bytesPerSample = (bitsPerSample + 7) / 8;
+        format.subSamplingW = subSamplingW;
+        format.subSamplingH = subSamplingH;
+        format.numPlanes = (colorFamily == cmGray) ? 1 : 3;
+    }
+    return &format;
+}
+
+static const VSCoreInfo * VS_CC getCoreInfo(VSCore * core) {
+    static VSCoreInfo info{ "tdeintmod-bench", 0, VAPOURSYNTH_API_VERSION, 1, 0, 0 };
+    return &info;
+}
+
+static int64_t VS_CC propGetInt(const VSMap * map, const char * key, int index, int * error) {
+    const auto it = map->ints.find(key);
+    if (it == map->ints.end() || index >= static_cast<int>(it->second.size())) {
+        if (error)
+            *error = peUnset;
+        return 0;
+    }
+
+    if (error)
+        *error = 0;
+    return it->second[index];
+}
+
+static int VS_CC propNumElements(const VSMap * map, const char * key) {
+    const auto it = map->ints.find(key);
+    return (it == map->ints.end()) ? -1 : static_cast<int>(it->second.size());
+}
+
+static VSNodeRef * VS_CC propGetNode(const VSMap * map, const char * key, int index, int * error) {
+    const auto it = map->nodes.find(key);
+    if (error)
+        *error = (it == map->nodes.end()) ? peUnset : 0;
+    return (it == map->nodes.end()) ? nullptr : it->second;
+}
+
+static const VSVideoInfo * VS_CC getVideoInfo(VSNodeRef * node) { return &node->vi; }
+static void VS_CC freeNode(VSNodeRef * node) {}
+static void VS_CC setError(VSMap * map, const char * errorMessage) { map->error = errorMessage; }
+
+static void VS_CC createFilter(const VSMap * in, VSMap * out, const char * name, VSFilterInit init, VSFilterGetFrame getFrame, VSFilterFree free, int filterMode,
+                               int flags, void * instanceData, VSCore * core) {
+    createdData = instanceData;
+    createdFree = free;
+}
+
+static VSAPI makeApi() {
+    VSAPI api{};
+    api.newVideoFrame = newVideoFrame;
+    api.freeFrame = freeFrame;
+    api.getStride = getStride;
+    api.getReadPtr = getReadPtr;
+    api.getWritePtr = getWritePtr;
+    api.getFrameWidth = getFrameWidth;
+    api.getFrameHeight = getFrameHeight;
+    api.getFrameFormat = getFrameFormat;
+    api.registerFormat = registerFormat;
+    api.getCoreInfo = getCoreInfo;
+    api.propGetInt = propGetInt;
+    api.propNumElements = propNumElements;
+    api.propGetNode = propGetNode;
+    api.getVideoInfo = getVideoInfo;
+    api.freeNode = freeNode;
+    api.setError = setError;
+    api.createFilter = createFilter;
+    return api;
+}
+
+static const VSAPI api = makeApi();
+
+//////////////////////////////////////////
+// Bench
+
+struct Filter {
+    void * data;
+    VSFilterFree free;
+
+    ~Filter() {
+        free(data, nullptr, &api);
+    }
+};
+
+// Runs a create function with the arguments in `in`, exits on any error it reports
+static Filter * create(const VSPublicFunction func, const VSMap & in) {
+    VSMap out;
+    createdData = nullptr;
+    func(&in, &out, nullptr, nullptr, &api);
+    if (!out.error.empty() || !createdData) {
+        fprintf(stderr, "tdeintmod-bench: %s\n", out.error.c_str());
+        exit(EXIT_FAILURE);
+    }
+    return new Filter{ createdData, createdFree };
+}
+
+// Frame t of a clip whose fields are half a frame apart in time. Bars and a disc drift across a ramp, so there is motion,
+// combing at their edges and stationary areas for every stage, with a little noise on top.
+static VSFrameRef * makeFrame(const VSFormat * format, const int width, const int height, const int t) {
+    VSFrameRef * frame = newVideoFrame(format, width, height, nullptr, nullptr);
+    const int peak = (1 << format->bitsPerSample) - 1;
+    uint32_t noise = 12345 + t;
+
+    for (int plane = 0; plane < format->numPlanes; plane++) {
+        const int w = frame->width[plane];
+        const int h = frame->height[plane];
+
+        for (int y = 0; y < h; y++) {
+            const double time = t + (y & 1) * 0.5;
+
+            for (int x = 0; x < w; x++) {
+                noise = noise * 1664525 + 1013904223;
+                const double bars = ((x + static_cast<int>(time * 6)) / 24 % 2) ? 0.25 : 0.0;
+                const double dx = x - w * 0.5 - time * 4, dy = y - h * 0.5;
+                const double disc = (dx * dx + dy * dy < h * h / 16.0) ? 0.3 : 0.0;
+                const double value = 0.1 + 0.3 * x / w + (y < h / 2 ? bars : disc) + (noise >> 28) / 512.0;
+                const int v = std::min(static_cast<int>(value * peak), peak);
+
+                if (format->bytesPerSample == 1)
+                    frame->data[plane][frame->stride[plane] * y + x] = static_cast<uint8_t>(v);
+                else
+                    reinterpret_cast<uint16_t *>(frame->data[plane] + frame->stride[plane] * y)[x] = static_cast<uint16_t>(v);
+            }
+        }
+    }
+
+    return frame;
+}
+
+// Seconds per call, the best of five batches that each take at least a fifth of minSeconds. A kernel that changes its own
+// input gets a prepare call before every call, which restores the input and is left out of the time.
+static double timeCall(const std::function<void()> & call, const std::function<void()> & prepare, const double minSeconds) {
+    using clock = std::chrono::steady_clock;
+
+    const auto batch = [&](const int reps) {
+        if (!prepare) {
+            const auto start = clock::now();
+            for (int i = 0; i < reps; i++)
+                call();
+            return std::chrono::duration<double>(clock::now() - start).count();
+        }
+
+        double seconds = 0;
+        for (int i = 0; i < reps; i++) {
+            prepare();
+            const auto start = clock::now();
+            call();
+            seconds += std::chrono::duration<double>(clock::now() - start).count();
+        }
+        return seconds;
+    };
+
+    batch(1);
+
+    int reps = 1;
+    double seconds;
+    while ((seconds = batch(reps)) < minSeconds / 5 && reps < (1 << 24))
+        reps *= 2;
+
+    double best = seconds / reps;
+    for (int i = 1; i < 5; i++)
+        best = std::min(best, batch(reps) / reps);
+    return best;
+}
+
+// Copies the planes of src into dst, which has the same format and size
+static void copyPlanes(const VSFrameRef * src, VSFrameRef * dst) {
+    for (int plane = 0; plane < src->format->numPlanes; plane++)
+        memcpy(dst->data[plane], src->data[plane], static_cast<size_t>(src->stride[plane]) * src->height[plane]);
+}
+
+struct Result {
+    std::string kernel, params, isa;
+    int bits, width, height;
+    int64_t pixels;
+    double seconds;
+};
+
+struct Tier {
+    int opt;
+    const char * name;
+};
+
+// The tiers selectFunctions can use on this cpu, by the opt value that asks for them
+static std::vector<Tier> availableTiers() {
+    std::vector<Tier> tiers{ { 1, "c" } };
+#ifdef VS_TARGET_CPU_X86
+    const int iset = instrset_detect();
+    if (iset >= 2)
+        tiers.push_back({ 2, "sse2" });
+    if (iset >= 8)
+        tiers.push_back({ 3, "avx2" });
+    if (iset >= 10)
+        tiers.push_back({ 4, "avx512" });
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    tiers.push_back({ 2, "neon" });
+#endif
+    return tiers;
+}
+
+class Bench {
+    const VSFormat * format;
+    const int width, height;
+    const Tier tier;
+    const double minSeconds;
+    VSNodeRef node;
+    VSFrameRef * frames[4];
+    std::vector<Result> & results;
+
+    // all the planes of a frame, or of a field when field is set
+    int64_t pixels(const bool field) const {
+        int64_t total = 0;
+        for (int plane = 0; plane < format->numPlanes; plane++)
+            total += static_cast<int64_t>(width >> (plane ? format->subSamplingW : 0)) * ((height >> (plane ? format->subSamplingH : 0)) / (field ? 2 : 1));
+        return total;
+    }
+
+    void run(const std::string & kernel, const std::string & params, const int64_t count, const std::function<void()> & call,
+             const std::function<void()> & prepare = nullptr) {
+        results.push_back({ kernel, params, tier.name, format->bitsPerSample, width, height, count, timeCall(call, prepare, minSeconds) });
+    }
+
+    VSMap tdeintmodArgs(const std::map<std::string, int64_t> & args) {
+        VSMap in;
+        in.nodes["clip"] = &node;
+        in.ints["order"] = { 1 };
+        in.ints["opt"] = { tier.opt };
+        for (const auto & arg : args)
+            in.ints[arg.first] = { arg.second };
+        return in;
+    }
+
+public:
+    Bench(const VSFormat * format_, const int width_, const int height_, const Tier tier_, const double minSeconds_, std::vector<Result> & results_):
+        format(format_), width(width_), height(height_), tier(tier_), minSeconds(minSeconds_), results(results_) {
+        node.vi = { format, 30000, 1001, width, height, 100, 0 };
+        for (int i = 0; i < 4; i++)
+            frames[i] = makeFrame(format, width, height, i);
+    }
+
+    ~Bench() {
+        for (auto frame : frames)
+            freeFrame(frame);
+    }
+
+    // The TMM stage of createMM, kernel by kernel
+    void tmm() {
+        for (int ttype = 0; ttype < 6; ttype++) {
+            std::unique_ptr<Filter> filter{ create(tdeintmodCreate, tdeintmodArgs({ { "ttype", ttype } })) };
+            const TDeintModData * d = static_cast<const TDeintModData *>(filter->data);
+            const int fieldHeight = height / 2;
+
+            // fld[i] holds the padded fields of frame i in [0, 3) and their threshold masks in [3, 6), as in createMM
+            VSFrameRef * fld[3][6];
+            for (int i = 0; i < 3; i++) {
+                for (int plane = 0; plane < 3; plane++) {
+                    fld[i][plane] = newVideoFrame(d->format, width + d->widthPad * 2, fieldHeight, nullptr, nullptr);
+                    fld[i][plane + 3] = newVideoFrame(d->format, width + d->widthPad * 2, fieldHeight * 2, nullptr, nullptr);
+                }
+            }
+
+            const auto padAll = [&](const int i) {
+                for (int plane = 0; plane < format->numPlanes; plane++)
+                    d->copyPad(frames[i], fld[i][plane], plane, 0, d->widthPad, &api);
+            };
+            const auto threshAll = [&](const int i) {
+                for (int plane = 0; plane < format->numPlanes; plane++)
+                    d->threshMask(fld[i][plane], fld[i][plane + 3], plane, 0, d, &api);
+            };
+
+            if (ttype == 1)
+                run("copyPad", "", pixels(true), [&] { padAll(0); });
+            for (int i = 0; i < 3; i++)
+                padAll(i);
+
+            run("threshMask", "ttype=" + std::to_string(ttype), pixels(true), [&] { threshAll(0); });
+
+            if (ttype == 1) {
+                for (int i = 0; i < 3; i++)
+                    threshAll(i);
+
+                VSFrameRef * mot[2] = {
+                    newVideoFrame(d->bitFormat, d->bitWidth, fieldHeight * 2, nullptr, nullptr),
+                    newVideoFrame(d->bitFormat, d->bitWidth, fieldHeight * 2, nullptr, nullptr)
+                };
+                VSFrameRef * mm = newVideoFrame(d->bitFormat, d->bitWidth, fieldHeight, nullptr, nullptr);
+
+                const auto motionAll = [&](const int i) {
+                    for (int plane = 0; plane < format->numPlanes; plane++)
+                        motionMask(fld[i][plane], fld[i][plane + 3], fld[i + 1][plane], fld[i + 1][plane + 3], mot[i], plane, 0, d, &api);
+                };
+
+                run("motionMask", "", pixels(true), [&] { motionAll(0); });
+                motionAll(1);
+
+                run("combineMasks", "", pixels(true), [&] {
+                    for (int plane = 0; plane < format->numPlanes; plane++)
+                        combineMasks(fld[0][plane], fld[0][plane + 3], fld[2][plane], fld[2][plane + 3], mot[0], mot[1], mm, plane, 0, d, &api);
+                });
+
+                freeFrame(mot[0]);
+                freeFrame(mot[1]);
+                freeFrame(mm);
+            }
+
+            for (int i = 0; i < 3; i++) {
+                for (auto frame : fld[i])
+                    freeFrame(frame);
+            }
+        }
+    }
+
+    // buildMask reads length - 2 TMM stages of either field. They all get the same stage, made from the synthetic frames.
+    void tmmBuild() {
+        for (int mtype = 0; mtype < 3; mtype++) {
+            for (int length : { 6, 10, 16 }) {
+                std::unique_ptr<Filter> filter{ create(tdeintmodCreate, tdeintmodArgs({ { "mtype", mtype }, { "length", length } })) };
+                const TDeintModData * d = static_cast<const TDeintModData *>(filter->data);
+                const int fieldHeight = height / 2;
+
+                VSFrameRef * fld[3][6];
+                VSFrameRef * mot[2];
+                VSFrameRef * mm = newVideoFrame(d->bitFormat, d->bitWidth, fieldHeight, nullptr, nullptr);
+                for (int i = 0; i < 3; i++) {
+                    for (int plane = 0; plane < 3; plane++) {
+                        fld[i][plane] = newVideoFrame(d->format, width + d->widthPad * 2, fieldHeight, nullptr, nullptr);
+                        fld[i][plane + 3] = newVideoFrame(d->format, width + d->widthPad * 2, fieldHeight * 2, nullptr, nullptr);
+                    }
+                    for (int plane = 0; plane < format->numPlanes; plane++) {
+                        d->copyPad(frames[i], fld[i][plane], plane, 0, d->widthPad, &api);
+                        d->threshMask(fld[i][plane], fld[i][plane + 3], plane, 0, d, &api);
+                    }
+                }
+                for (int i = 0; i < 2; i++) {
+                    mot[i] = newVideoFrame(d->bitFormat, d->bitWidth, fieldHeight * 2, nullptr, nullptr);
+                    for (int plane = 0; plane < format->numPlanes; plane++)
+                        motionMask(fld[i][plane], fld[i][plane + 3], fld[i + 1][plane], fld[i + 1][plane + 3], mot[i], plane, 0, d, &api);
+                }
+                for (int plane = 0; plane < format->numPlanes; plane++)
+                    combineMasks(fld[0][plane], fld[0][plane + 3], fld[2][plane], fld[2][plane + 3], mot[0], mot[1], mm, plane, 0, d, &api);
+
+                // the counts of buildMM for a frame in the middle of a top field first clip, interpolating the bottom field
+                const int oCount = (length - 1) / 2 * 2 - 1;
+                const int cCount = (length - 2) / 2 * 2;
+                std::vector<const VSFrameRef *> cSrc(cCount, mm), oSrc(oCount, mm);
+                VSFrameRef * mask = newVideoFrame(d->maskFormat, width, height, nullptr, nullptr);
+
+                run("buildMask", "mtype=" + std::to_string(mtype) + ",length=" + std::to_string(length), pixels(false),
+                    [&] { d->buildMask(cSrc.data(), oSrc.data(), mask, cCount, oCount, 1, 1, 0, d, &api); });
+
+                freeFrame(mask);
+                freeFrame(mm);
+                for (int i = 0; i < 2; i++)
+                    freeFrame(mot[i]);
+                for (int i = 0; i < 3; i++) {
+                    for (auto frame : fld[i])
+                        freeFrame(frame);
+                }
+            }
+        }
+    }
+
+    // The stages of tdeintmodGetFrame after the TMM mask. The mask stages work in place, so each one starts every call from a
+    // copy of the mask the stage before it hands on, as in a real frame.
+    void deint() {
+        for (int metric = 0; metric < 2; metric++) {
+            std::unique_ptr<Filter> filter{ create(tdeintmodCreate, tdeintmodArgs({ { "athresh", 12 }, { "metric", metric }, { "expand", 4 } })) };
+            const TDeintModData * d = static_cast<const TDeintModData *>(filter->data);
+
+            VSFrameRef * upsized = newVideoFrame(d->maskFormat, width, height, nullptr, nullptr);
+            VSFrameRef * spatial = newVideoFrame(d->maskFormat, width, height, nullptr, nullptr);
+            VSFrameRef * expanded = newVideoFrame(d->maskFormat, width, height, nullptr, nullptr);
+            VSFrameRef * linked = newVideoFrame(d->maskFormat, width, height, nullptr, nullptr);
+            VSFrameRef * mask = newVideoFrame(d->maskFormat, width, height, nullptr, nullptr);
+            VSFrameRef * dst = newVideoFrame(format, width, height, nullptr, nullptr);
+
+            d->setMaskForUpsize(upsized, 1, 0, d, &api);
+            copyPlanes(upsized, spatial);
+            d->checkSpatial(frames[1], spatial, 0, d, &api);
+            copyPlanes(spatial, expanded);
+            d->expandMask(expanded, 1, 0, d, &api);
+            copyPlanes(expanded, linked);
+            d->linkMask(linked, 1, 0, d, &api);
+
+            run("checkSpatial", "metric=" + std::to_string(metric), pixels(false), [&] { d->checkSpatial(frames[1], mask, 0, d, &api); },
+                [&] { copyPlanes(upsized, mask); });
+
+            if (metric == 0) {
+                run("setMaskForUpsize", "", pixels(false), [&] { d->setMaskForUpsize(mask, 1, 0, d, &api); });
+                run("expandMask", "expand=4", pixels(false), [&] { d->expandMask(mask, 1, 0, d, &api); }, [&] { copyPlanes(spatial, mask); });
+                run("linkMask", "", pixels(false), [&] { d->linkMask(mask, 1, 0, d, &api); }, [&] { copyPlanes(expanded, mask); });
+                run("eDeint", "", pixels(false), [&] { d->eDeint(dst, linked, frames[0], frames[1], frames[2], frames[3], 0, d, &api); });
+                run("cubicDeint", "", pixels(false), [&] { d->cubicDeint(dst, linked, frames[0], frames[1], frames[2], 0, d, &api); });
+                run("binaryMask", "", pixels(false), [&] { d->binaryMask(linked, dst, 0, d, &api); });
+            }
+
+            for (auto frame : { upsized, spatial, expanded, linked, mask, dst })
+                freeFrame(frame);
+        }
+    }
+
+    // The comb check of IsCombed with stats, so every block is counted whatever the frame looks like
+    void combed() {
+        const std::pair<const char *, std::map<std::string, std::vector<int64_t>>> sets[] = {
+            { "stats=1", { { "stats", { 1 } } } },
+            { "stats=1,chroma=1", { { "stats", { 1 } }, { "chroma", { 1 } } } },
+            { "stats=1,cthresh=[4,6,8,10],metric=[0,1]", { { "stats", { 1 } }, { "cthresh", { 4, 6, 8, 10 } }, { "metric", { 0, 1 } } } }
+        };
+
+        for (const auto & set : sets) {
+            VSMap in;
+            in.nodes["clip"] = &node;
+            in.ints = set.second;
+            in.ints["opt"] = { tier.opt };
+
+            std::unique_ptr<Filter> filter{ create(iscombedCreate, in) };
+            const IsCombedData * d = static_cast<const IsCombedData *>(filter->data);
+
+            run("checkCombed", set.first, pixels(false), [&] { isCombed(frames[1], nullptr, nullptr, d, &api); });
+        }
+    }
+};
+
+static void printJson(const std::vector<Result> & results, const std::vector<Tier> & tiers) {
+    // speedups are over the c tier of the same kernel, parameters and clip
+    std::map<std::tuple<std::string, std::string, int, int, int>, double> base;
+    for (const auto & r : results) {
+        if (r.isa == "c")
+            base[std::make_tuple(r.kernel, r.params, r.bits, r.width, r.height)] = r.seconds;
+    }
+
+    printf("{\n  \"isa\": [");
+    for (size_t i = 0; i < tiers.size(); i++)
+        printf("%s\"%s\"", i ? ", " : "", tiers[i].name);
+    printf("],\n  \"results\": [\n");
+
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result & r = results[i];
+        const int bytesPerSample = (r.bits + 7) / 8;
+        const double speedup = base[std::make_tuple(r.kernel, r.params, r.bits, r.width, r.height)] / r.seconds;
+
+        printf("    {\"kernel\": \"%s\", \"params\": \"%s\", \"isa\": \"%s\", \"bits\": %d, \"width\": %d, \"height\": %d, \"pixels\": %lld, "
+               "\"ns_per_pixel\": %.4f, \"gb_per_s\": %.3f, \"speedup\": %.2f}%s\n",
+               r.kernel.c_str(), r.params.c_str(), r.isa.c_str(), r.bits, r.width, r.height, static_cast<long long>(r.pixels),
+               r.seconds * 1e9 / r.pixels, r.pixels * bytesPerSample / r.seconds / 1e9, speedup, (i + 1 < results.size()) ? "," : "");
+    }
+
+    printf("  ]\n}\n");
+}
+
+static void usage() {
+    fprintf(stderr,
+            "usage: tdeintmod-bench [--time seconds] [--opt n[,n...]] [--bits n[,n...]] [--size WxH[,WxH...]]\n"
+            "  --time  minimum time spent on every measurement, 0.2 by default\n"
+            "  --opt   instruction set tiers to run, as the opt argument of the filters, all the cpu has by default\n"
+            "  --bits  bit depths, 8,10,16 by default\n"
+            "  --size  resolutions, 720x480,1920x1080 by default\n");
+    exit(EXIT_FAILURE);
+}
+
+static std::vector<std::string> split(const std::string & list) {
+    std::vector<std::string> items;
+    size_t start = 0, comma;
+    while ((comma = list.find(',', start)) != std::string::npos) {
+        items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    items.push_back(list.substr(start));
+    return items;
+}
+
+int main(int argc, char ** argv) {
+    double minSeconds = 0.2;
+    std::vector<Tier> tiers = availableTiers();
+    std::vector<int> depths{ 8, 10, 16 };
+    std::vector<std::pair<int, int>> sizes{ { 720, 480 }, { 1920, 1080 } };
+
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (i + 1 == argc)
+            usage();
+        const std::string value = argv[++i];
+
+        if (arg == "--time") {
+            minSeconds = std::atof(value.c_str());
+        } else if (arg == "--opt") {
+            std::vector<Tier> chosen;
+            for (const auto & item : split(value)) {
+                const int opt = std::atoi(item.c_str());
+                for (const auto & tier : tiers) {
+                    if (tier.opt == opt)
+                        chosen.push_back(tier);
+                }
+            }
+            tiers = chosen;
+        } else if (arg == "--bits") {
+            depths.clear();
+            for (const auto & item : split(value))
+                depths.push_back(std::atoi(item.c_str()));
+        } else if (arg == "--size") {
+            sizes.clear();
+            for (const auto & item : split(value)) {
+                int w, h;
+                if (sscanf(item.c_str(), "%dx%d", &w, &h) != 2)
+                    usage();
+                sizes.push_back({ w, h });
+            }
+        } else {
+            usage();
+        }
+    }
+
+    std::vector<Result> results;
+
+    for (const int bits : depths) {
+        const VSFormat * format = registerFormat(cmYUV, stInteger, bits, 1, 1, nullptr);
+
+        for (const auto & size : sizes) {
+            for (const auto & tier : tiers) {
+                fprintf(stderr, "%d-bit %dx%d %s\n", bits, size.first, size.second, tier.name);
+
+                Bench bench{ format, size.first, size.second, tier, minSeconds, results };
+                bench.tmm();
+                bench.tmmBuild();
+                bench.deint();
+                bench.combed();
+            }
+        }
+    }
+
+    printJson(results, tiers);
+    return 0;
+}